@@ -27,17 +27,117 @@
  *============================================================================*/
 #include "advertise.h"
 #include "remote.h"
+#include "bond_table.h"
 #include "state.h"
 #include "appearance.h"
 #include "uuids_hid.h"
 #include "service_gap.h"
 #include "remote_gatt.h"
+#include "perf_stats.h"
+
+/*=============================================================================
+ *  Private Definitions
+ *============================================================================*/
+
+/* The most AD structures added to the advertising and scan response data:
+ * the service UUID list, appearance, Tx power and device name.
+ */
+#define MAX_AD_ELEMENTS                         (4)
+
+/* Length of the 16-bit service UUID list prefixed with its AD Type */
+#define SERVICE_UUID_LIST_LENGTH                (3)
+
+/*=============================================================================
+ *  Private Data Types
+ *============================================================================*/
+
+/* One AD structure (AD Type followed by its value) of the advertising or scan
+ * response data
+ */
+typedef struct
+{
+    uint8           *data;
+    uint16          length;
+    ad_src          src;
+} AD_ELEMENT_T;
+
+/* The advertising and scan response data for undirected advertisements. It
+ * is built the first time it is needed and again only when the device name
+ * or Tx power changes (see AdvInvalidatePayload()).
+ */
+typedef struct
+{
+    /* The elements below are up to date */
+    bool            valid;
+    uint16          num_elements;
+    AD_ELEMENT_T    element[MAX_AD_ELEMENTS];
+
+    /* Storage for the AD structures not held elsewhere */
+    uint8           service_uuid_list[SERVICE_UUID_LIST_LENGTH];
+    uint8           tx_power[TX_POWER_VALUE_LENGTH];
+} ADV_PAYLOAD_T;
+
+#if defined(FAST_RECONNECT) && !defined(__GAP_PRIVACY_SUPPORT__)
+/* Directed advertising to the bonded host, prepared ahead of the wake-up that
+ * needs it (see AdvPrepareDirected())
+ */
+typedef struct
+{
+    /* The set-up below is usable */
+    bool            valid;
+    /* The host being advertised to */
+    TYPED_BD_ADDR_T target;
+    /* The flags passed to GattConnectReq() */
+    uint16          connect_flags;
+} DIRECTED_ADV_T;
+#endif /* FAST_RECONNECT && !__GAP_PRIVACY_SUPPORT__ */
+
+/*=============================================================================
+ *  Private Data
+ *============================================================================*/
+static ADV_PAYLOAD_T adv_payload;
+
+/* The advertising schedule */
+DECLARE_ADV_SCHEDULE();
+
+/* Device appearance prefixed with 'Appearance' AD Type */
+static uint8 device_appearance[ATTR_LEN_DEVICE_APPEARANCE + 1] = {
+            AD_TYPE_APPEARANCE,
+            LE8_L(APPEARANCE_REMOTE_VALUE),
+            LE8_H(APPEARANCE_REMOTE_VALUE)
+    };
+
+#if defined(FAST_RECONNECT) && !defined(__GAP_PRIVACY_SUPPORT__)
+static DIRECTED_ADV_T directed_adv;
+#endif /* FAST_RECONNECT && !__GAP_PRIVACY_SUPPORT__ */
 
 
 /*=============================================================================
  *  Private Function Definitions
  *============================================================================*/
 
+/*-----------------------------------------------------------------------------*
+ *  NAME
+ *      addAdElement
+ *
+ *  DESCRIPTION
+ *      This function adds an AD structure to the advertising payload. The data
+ *      must remain valid for as long as the payload does.
+ *
+ *  RETURNS/MODIFIES
+ *      Nothing.
+ *
+ *----------------------------------------------------------------------------*/
+
+static void addAdElement(uint16 length, uint8 *data, ad_src src)
+{
+    AD_ELEMENT_T *element = &adv_payload.element[adv_payload.num_elements++];
+
+    element->data = data;
+    element->length = length;
+    element->src = src;
+}
+
 /*-----------------------------------------------------------------------------*
  *  NAME
  *      getSupported16BitUUIDServiceList
@@ -71,7 +171,7 @@ static uint16 getSupported16BitUUIDServiceList(uint8 *p_service_uuid_ad)
  *
  *  DESCRIPTION
  *      This function is used to add the device name to the advertising-
- *      or scan-response packet.
+ *      or scan-response payload.
  *      It tries the following:
  *      a. Try to add complete device name to the advertisment packet
  *      b. Try to add complete device name to the scan response packet
@@ -108,7 +208,7 @@ static void addDeviceNameToAdvData(uint16 adv_data_len, uint16 scan_data_len)
     if((device_name_adtype_len + 1) <= (MAX_ADV_DATA_LEN - adv_data_len))
     {
         /* Add Complete Device Name to Advertisement Data */
-        (void)LsStoreAdvScanData(device_name_adtype_len, p_device_name, ad_src_advertise);
+        addAdElement(device_name_adtype_len, p_device_name, ad_src_advertise);
     }
     /* Determine whether the complete device name can fit into
      * the remaining space in the scan response message.
@@ -116,7 +216,7 @@ static void addDeviceNameToAdvData(uint16 adv_data_len, uint16 scan_data_len)
     else if((device_name_adtype_len + 1) <= (MAX_ADV_DATA_LEN - scan_data_len)) 
     {
         /* Add Complete Device Name to Scan Response Data */
-        (void)LsStoreAdvScanData(device_name_adtype_len, p_device_name, ad_src_scan_rsp);
+        addAdElement(device_name_adtype_len, p_device_name, ad_src_scan_rsp);
     }
     /* Determine whether the shortened device name can fit into
      * the remaining space in the advertising packet.
@@ -129,23 +229,24 @@ static void addDeviceNameToAdvData(uint16 adv_data_len, uint16 scan_data_len)
         /* Record that the advertising packet contains a shortened name. */
         p_device_name[0] = AD_TYPE_LOCAL_NAME_SHORT;
 
-        (void)LsStoreAdvScanData(SHORTENED_DEV_NAME_LEN, p_device_name, ad_src_advertise);
+        addAdElement(SHORTENED_DEV_NAME_LEN, p_device_name, ad_src_advertise);
     }
     else /* Add the shortened device name to the scan-response message. */
     {
         /* Record that the scan-response message contains a shortened name. */
         p_device_name[0] = AD_TYPE_LOCAL_NAME_SHORT;
 
-        (void)LsStoreAdvScanData((MAX_ADV_DATA_LEN - scan_data_len), p_device_name, ad_src_scan_rsp);
+        addAdElement((MAX_ADV_DATA_LEN - scan_data_len), p_device_name, ad_src_scan_rsp);
     }
 }
 
 /*-----------------------------------------------------------------------------*
  *  NAME
- *      setAdvertisingParameters
+ *      buildAdvPayload
  *
  *  DESCRIPTION
- *      This function is used to set advertising parameters.
+ *      This function builds the advertising and scan response data used for
+ *      undirected advertisements.
  *
  *  RETURNS/MODIFIES
  *      Nothing.
@@ -153,15 +254,92 @@ static void addDeviceNameToAdvData(uint16 adv_data_len, uint16 scan_data_len)
  *  NOTES:
  *  Add device name in the end so that either full name or partial name is added
  *  to AdvData or scan data depending upon the space left in the two fields.
+ *  The data must match what was built on every start before the payload was
+ *  cached. To check on target, capture the advertising and scan response
+ *  PDUs with a sniffer (short and 20-character names, fast and slow
+ *  advertising, and after the host writes a new name) and compare them with
+ *  those of a build from before the cache.
  *----------------------------------------------------------------------------*/
 
-static void setAdvertisingParameters(bool fast_connection, gap_mode_connect connect_mode)
+static void buildAdvPayload(void)
 {
-    uint8 advert_data[MAX_ADV_DATA_LEN];
     uint16 length;
-    uint32 adv_interval_min = RP_ADVERTISING_INTERVAL_MIN;
-    uint32 adv_interval_max = RP_ADVERTISING_INTERVAL_MAX;
     int8 tx_power_level; /* Unsigned value */
+
+    /* A variable to keep track of the data added to AdvData. The limit is
+     * MAX_ADV_DATA_LEN. GAP layer will add AD Flags to AdvData which is 3
+     * bytes. Refer BT Spec 4.0, Vol 3, Part C, Sec 11.1.3.
+     */
+    uint16 length_added_to_adv = 3;
+    uint16 length_added_to_scan = 0;
+
+    adv_payload.num_elements = 0;
+
+    /* Set up the advertising data. The GAP layer will automatically add the
+     * AD Flags field so all we need to do here is add 16-bit supported 
+     * services UUID and Complete Local Name type. Applications are free to
+     * add any other AD types based upon the profile requirements and
+     * subject to the maximum AD size of 31 octets.
+     */
+
+    /* Add 16-bit UUID list of the services supported by the device */
+    length = getSupported16BitUUIDServiceList(adv_payload.service_uuid_list);
+
+    /* Before adding data to the ADV_IND, increment 'lengthAddedToAdv' to
+     * keep track of the total number of bytes added to ADV_IND. At the end
+     * while adding the device name to the ADV_IND, this can be used to
+     * verify whether the complete name can fit into the AdvData adhering to
+     * the limit of 31 octets. In addition to the above populated fields, a
+     * 'length' field will also be added to AdvData by GAP layer. Refer
+     * BT 4.0 spec, Vol 3, Part C, Figure 11.1.
+     */
+    length_added_to_adv += (length + 1);
+    addAdElement(length, adv_payload.service_uuid_list, ad_src_advertise);
+
+    length_added_to_adv += (sizeof(device_appearance) + 1);
+    /* Add device appearance as advertisement data */
+    addAdElement(sizeof(device_appearance), device_appearance, ad_src_advertise);
+
+    /* If 128-bit proprietary service UUID is added to the advData, there
+     * will be no space left for any more data. So don't add the
+     * TxPowerLevel to the advData.
+     */
+
+    /* Read tx power of the chip */
+    (void)LsReadTransmitPowerLevel(&tx_power_level);
+
+    /* Tx power level value prefixed with 'Tx Power' AD Type 
+     * Tx power level value is of 1 byte 
+     */
+    adv_payload.tx_power[0] = AD_TYPE_TX_POWER;
+    adv_payload.tx_power[TX_POWER_VALUE_LENGTH - 1] = (uint8)tx_power_level;
+
+    length_added_to_scan += TX_POWER_VALUE_LENGTH + 1;
+    
+    /* Add tx power value of device to the scan response data */
+    addAdElement(TX_POWER_VALUE_LENGTH, adv_payload.tx_power, ad_src_scan_rsp);
+   
+    addDeviceNameToAdvData(length_added_to_adv, length_added_to_scan);
+
+    adv_payload.valid = TRUE;
+}
+
+/*-----------------------------------------------------------------------------*
+ *  NAME
+ *      setAdvertisingParameters
+ *
+ *  DESCRIPTION
+ *      This function is used to set advertising parameters.
+ *
+ *  RETURNS/MODIFIES
+ *      Nothing.
+ *
+ *----------------------------------------------------------------------------*/
+
+static void setAdvertisingParameters(uint16 stage, gap_mode_connect connect_mode)
+{
+    uint32 adv_interval = advSchedule[stage].interval;
+    uint16 i;
     
     TYPED_BD_ADDR_T temp_addr;
 
@@ -176,29 +354,6 @@ static void setAdvertisingParameters(bool fast_connection, gap_mode_connect conn
 #endif /* __GAP_PRIVACY_SUPPORT__ */
     }
 
-    /* A variable to keep track of the data added to AdvData. The limit is
-     * MAX_ADV_DATA_LEN. GAP layer will add AD Flags to AdvData which is 3
-     * bytes. Refer BT Spec 4.0, Vol 3, Part C, Sec 11.1.3.
-     */
-    uint16 length_added_to_adv = 3;
-    uint16 length_added_to_scan = 0;
-    
-    /* Tx power level value prefixed with 'Tx Power' AD Type */
-    uint8 device_tx_power[TX_POWER_VALUE_LENGTH] = {
-                AD_TYPE_TX_POWER};
-    
-    uint8 device_appearance[ATTR_LEN_DEVICE_APPEARANCE + 1] = {
-                AD_TYPE_APPEARANCE,
-                LE8_L(APPEARANCE_REMOTE_VALUE),
-                LE8_H(APPEARANCE_REMOTE_VALUE)
-        };
-
-    if(fast_connection)
-    {
-        adv_interval_min = FC_ADVERTISING_INTERVAL_MIN;
-        adv_interval_max = FC_ADVERTISING_INTERVAL_MAX;
-    }
-
     (void)GapSetMode(gap_role_peripheral, 
                      gap_mode_discover_general,
                      connect_mode,
@@ -218,56 +373,31 @@ static void setAdvertisingParameters(bool fast_connection, gap_mode_connect conn
     if(connect_mode == gap_mode_connect_directed)
     {
         GapSetAdvAddress(&temp_addr);
+
+        /* Directed advertising runs at its own (high duty cycle) rate */
+        perfAdvertisingStart(0);
     }
     else
     {
         /* Advertisement interval will be ignored for directed advertisement */
-        (void)GapSetAdvInterval(adv_interval_min, adv_interval_max);
-
-        /* Set up the advertising data. The GAP layer will automatically add the
-         * AD Flags field so all we need to do here is add 16-bit supported 
-         * services UUID and Complete Local Name type. Applications are free to
-         * add any other AD types based upon the profile requirements and
-         * subject to the maximum AD size of 31 octets.
-         */
-
-        /* Add 16-bit UUID list of the services supported by the device */
-        length = getSupported16BitUUIDServiceList(advert_data);
-
-        /* Before adding data to the ADV_IND, increment 'lengthAddedToAdv' to
-         * keep track of the total number of bytes added to ADV_IND. At the end
-         * while adding the device name to the ADV_IND, this can be used to
-         * verify whether the complete name can fit into the AdvData adhering to
-         * the limit of 31 octets. In addition to the above populated fields, a
-         * 'length' field will also be added to AdvData by GAP layer. Refer
-         * BT 4.0 spec, Vol 3, Part C, Figure 11.1.
-         */
-        length_added_to_adv += (length + 1);
-        (void)LsStoreAdvScanData(length, advert_data, ad_src_advertise);
-
-        length_added_to_adv += (sizeof(device_appearance) + 1);
-        /* Add device appearance as advertisement data */
-        (void)LsStoreAdvScanData(sizeof(device_appearance), device_appearance, ad_src_advertise);
+        (void)GapSetAdvInterval(adv_interval, adv_interval);
+        perfAdvertisingStart(adv_interval);
 
-        /* If 128-bit proprietary service UUID is added to the advData, there
-         * will be no space left for any more data. So don't add the
-         * TxPowerLevel to the advData.
-         */
-
-        /* Read tx power of the chip */
-        (void)LsReadTransmitPowerLevel(&tx_power_level);
+        if(!adv_payload.valid)
+        {
+            buildAdvPayload();
+        }
 
-        /* Add the read tx power level to g_device_tx_power 
-         * Tx power level value is of 1 byte 
+        /* Store the advertising and scan response data. The GAP layer adds
+         * the length field of each AD structure, so they are stored one at a
+         * time.
          */
-        device_tx_power[TX_POWER_VALUE_LENGTH - 1] = (uint8)tx_power_level;
-
-        length_added_to_scan += TX_POWER_VALUE_LENGTH + 1;
-        
-        /* Add tx power value of device to the scan response data */
-        (void)LsStoreAdvScanData(TX_POWER_VALUE_LENGTH, device_tx_power, ad_src_scan_rsp);
-       
-        addDeviceNameToAdvData(length_added_to_adv, length_added_to_scan);
+        for(i = 0; i < adv_payload.num_elements; i++)
+        {
+            (void)LsStoreAdvScanData(adv_payload.element[i].length,
+                                     adv_payload.element[i].data,
+                                     adv_payload.element[i].src);
+        }
     }
 }
 
@@ -276,9 +406,8 @@ static void setAdvertisingParameters(bool fast_connection, gap_mode_connect conn
  *      advertisingTimerHandler
  *
  *  DESCRIPTION
- *      This function is used to stop on-going advertisements at the expiry of 
- *      SLOW_CONNECTION_ADVERT_TIMEOUT_VALUE or 
- *      FAST_CONNECTION_ADVERT_TIMEOUT_VALUE timer.
+ *      This function is used to stop on-going advertisements at the end of a
+ *      stage of the advertising schedule.
  *
  *  RETURNS/MODIFIES
  *      Nothing.
@@ -306,31 +435,57 @@ static void advertisingTimerHandler(timer_id tid)
  *      AdvStart
  *
  *  DESCRIPTION
- *      This function is used to start undirected advertisements.
+ *      This function is used to start directed advertisements, or undirected
+ *      advertisements for the given stage of the advertising schedule.
  *
  *  RETURNS/MODIFIES
  *      Nothing.
  *
  *----------------------------------------------------------------------------*/
  
-extern void AdvStart(bool fast_connection, gap_mode_connect connect_mode)
+extern void AdvStart(uint16 stage, gap_mode_connect connect_mode)
 {
     uint16 connect_flags = L2CAP_CONNECTION_SLAVE_UNDIRECTED | 
                           L2CAP_OWN_ADDR_TYPE_PUBLIC;
-    uint32 timeout;
 
     /* Set UCID to INVALID_UCID */
     localData.st_ucid = GATT_INVALID_UCID;
 
+    /* Stop the timer of any stage being cut short */
+    TimerDelete(localData.advertising_tid);
+    localData.advertising_tid = TIMER_INVALID;
+
+#if defined(FAST_RECONNECT) && !defined(__GAP_PRIVACY_SUPPORT__)
+    if((connect_mode == gap_mode_connect_directed) && directed_adv.valid)
+    {
+        /* Directed advertisements carry no advertising or scan response data,
+         * so there is nothing to rebuild: go straight to advertising.
+         */
+        (void)GapSetMode(gap_role_peripheral, 
+                         gap_mode_discover_general,
+                         gap_mode_connect_directed,
+                         gap_mode_bond_yes,
+                         gap_mode_security_unauthenticate);
+        GapSetAdvAddress(&directed_adv.target);
+        perfAdvertisingStart(0);
+
+        GattConnectReq(NULL, directed_adv.connect_flags);
+        return;
+    }
+#endif /* FAST_RECONNECT && !__GAP_PRIVACY_SUPPORT__ */
+
     /* Set advertisement parameters */
-    setAdvertisingParameters(fast_connection, connect_mode);
+    setAdvertisingParameters(stage, connect_mode);
 
     /* If white list is enabled, set the controller's advertising filter policy 
      * to "process scan and connection requests only from devices in the White 
-     * List"
+     * List". Undirected advertisements must reach all the bonded hosts, so
+     * they can only use the White List if it holds all of them.
      */
     if(localData.bonded && 
-        !IsAddressResolvableRandom(&localData.bonded_bd_addr))
+        ((connect_mode == gap_mode_connect_directed) ?
+            !IsAddressResolvableRandom(&localData.bonded_bd_addr) :
+            BondTableWhiteListComplete()))
     {
         connect_flags = (L2CAP_CONNECTION_SLAVE_WHITELIST | L2CAP_OWN_ADDR_TYPE_PUBLIC);
         
@@ -371,14 +526,9 @@ extern void AdvStart(bool fast_connection, gap_mode_connect connect_mode)
      /* Start advertisement timer */
     if(connect_mode == gap_mode_connect_undirected)
     {
-        /* Set the timeout value according to the "fast_connection" parameter */
-        timeout = (fast_connection) 
-            ? FAST_CONNECTION_ADVERT_TIMEOUT_VALUE 
-            : SLOW_CONNECTION_ADVERT_TIMEOUT_VALUE;
-
-        /* Re-start advertisement timer  */
-        TimerDelete(localData.advertising_tid);
-        localData.advertising_tid = TimerCreate(timeout, TRUE, advertisingTimerHandler);
+        /* Advertise for as long as this stage lasts */
+        localData.advertising_tid = TimerCreate(advSchedule[stage].duration,
+                                                TRUE, advertisingTimerHandler);
     }
 }
 
@@ -398,3 +548,64 @@ extern void AdvStop(void)
 {
     GattCancelConnectReq();
 }
+
+/*-----------------------------------------------------------------------------*
+ *  NAME
+ *      AdvInvalidatePayload
+ *
+ *  DESCRIPTION
+ *      This function is called when the device name or Tx power has changed,
+ *      so that the advertising and scan response data is rebuilt the next time
+ *      undirected advertisements start.
+ *
+ *  RETURNS/MODIFIES
+ *      Nothing.
+ *
+ *----------------------------------------------------------------------------*/
+ 
+extern void AdvInvalidatePayload(void)
+{
+    adv_payload.valid = FALSE;
+}
+
+#if defined(FAST_RECONNECT)
+/*-----------------------------------------------------------------------------*
+ *  NAME
+ *      AdvPrepareDirected
+ *
+ *  DESCRIPTION
+ *      This function prepares the directed advertisements that AdvStart()
+ *      will use to reconnect to the bonded host. It is called whenever the
+ *      bonding changes (along with the whitelist update), so that a wake-up
+ *      from idle only has to start the advertisements.
+ *
+ *  RETURNS/MODIFIES
+ *      Nothing.
+ *
+ *  NOTES:
+ *  With privacy support the reconnection address and privacy flag can be
+ *  changed by the host at any time, so AdvStart() always works them out.
+ *----------------------------------------------------------------------------*/
+ 
+extern void AdvPrepareDirected(void)
+{
+#if !defined(__GAP_PRIVACY_SUPPORT__)
+    /* These are the conditions under which determineAdvertisingType() chooses
+     * directed advertising and AdvStart() uses the whitelist.
+     */
+    directed_adv.valid = (localData.bonded &&
+                          !IsAddressResolvableRandom(&localData.bonded_bd_addr));
+
+    if(directed_adv.valid)
+    {
+        directed_adv.target.type = ls_addr_type_public;
+        MemCopy(&directed_adv.target.addr, &(localData.bonded_bd_addr.addr), 
+                sizeof(BD_ADDR_T));
+
+        directed_adv.connect_flags = L2CAP_CONNECTION_SLAVE_WHITELIST | 
+                                     L2CAP_OWN_ADDR_TYPE_PUBLIC |
+                                     L2CAP_CONNECTION_SLAVE_DIRECTED;
+    }
+#endif /* !__GAP_PRIVACY_SUPPORT__ */
+}
+#endif /* FAST_RECONNECT */
@@ -17,6 +17,11 @@
 #include <types.h>
 #include <gap_types.h>
 
+/*============================================================================*
+ *  Local Header Files
+ *============================================================================*/
+#include "configuration.h"
+
 /*============================================================================*
  *  Public definitions
  *============================================================================*/
@@ -32,11 +37,28 @@
 /* Acceptable shortened device name length that can be sent in advData */
 #define SHORTENED_DEV_NAME_LEN                 (8)
 
+/*============================================================================*
+ *  Public Data Types
+ *============================================================================*/
+
+/* One stage of the advertising schedule (see DECLARE_ADV_SCHEDULE()) */
+typedef struct
+{
+    uint32 interval;            /* Advertising interval (us) */
+    uint32 duration;            /* Time spent in this stage (us) */
+} ADV_STAGE_T;
+
 /*=============================================================================
  *  Public Function Prototypes
  *============================================================================*/
 
-extern void AdvStart(bool fast_connection, gap_mode_connect connect_mode);
+extern void AdvStart(uint16 stage, gap_mode_connect connect_mode);
 extern void AdvStop(void);
+/* The advertising data must be rebuilt (the device name or Tx power changed) */
+extern void AdvInvalidatePayload(void);
+#if defined(FAST_RECONNECT)
+/* Prepare directed advertising to the bonded host (if any) */
+extern void AdvPrepareDirected(void);
+#endif /* FAST_RECONNECT */
 
 #endif /* ADVERTISE_H */
\ No newline at end of file
@@ -0,0 +1,631 @@
+/*******************************************************************************
+ *    Copyright (C) Cambridge Silicon Radio Limited 2015
+ *
+ * FILE
+ *    bond_table.c
+ *
+ *  DESCRIPTION
+ *    The bond table: the hosts the remote is bonded to, and the NVM copies of
+ *    their service data. The NVM holds, after the core application data:
+ *
+ *      NVM_OFFSET_BOND_TABLE   BOND_TABLE_SIZE entries of BOND_ENTRY_T
+ *      ...
+ *      service data offset     BOND_TABLE_SIZE copies of the service data
+ *                              (GATT, HID, Battery), one per entry, then
+ *                              one more used while pairing
+ *
+ *    Switching host only changes which entry and which copy of the service
+ *    data are in use; nothing has to be paired again. When a host connects
+ *    it is found by its address (or resolved with its IRK) and becomes the
+ *    current host. Reconnection is tried first with the most recently used
+ *    host (directed advertisements), then with all of them (undirected
+ *    advertisements using the whitelist).
+ *
+ *    The entry of a host records when it was last used, so that the table
+ *    keeps its "last used" order in NVM without any other bookkeeping. Only
+ *    this word is written when the remote moves to a different host.
+ *
+ *    While the remote is not bonded (pairing) the services use the extra
+ *    copy of the service data, and the table is left as it is. Only once a
+ *    host has paired is an entry chosen for it (its old entry, a free one,
+ *    or that of the least recently used host) and the copy moved there, so
+ *    a pairing that fails or is abandoned does not lose any host.
+ *
+ ******************************************************************************/
+
+/*=============================================================================
+ *  SDK Header Files
+ *============================================================================*/
+#include <types.h>
+#include <mem.h>
+#include <security.h>
+#include <ls_app_if.h>
+
+/*=============================================================================
+ *  Local Header Files
+ *============================================================================*/
+#include "bond_table.h"
+#include "remote.h"
+#include "nvm_access.h"
+#include "remote_gatt.h"
+#include "advertise.h"
+#include "service_gatt.h"
+#include "service_hid.h"
+#include "service_battery.h"
+
+/*=============================================================================
+ *  Private Definitions
+ *============================================================================*/
+
+/* The NVM offset of an entry of the bond table */
+#define BOND_ENTRY_NVM_OFFSET(_h_)  (NVM_OFFSET_BOND_TABLE + \
+                                     ((_h_) * sizeof(BOND_ENTRY_T)))
+
+/* The largest 'last_used' value before the entries are renumbered */
+#define BOND_LAST_USED_MAX          (0xffff)
+
+/* The copy of the service data used while the remote is not bonded */
+#define PAIRING_SERVICE_DATA        (BOND_TABLE_SIZE)
+
+/* The number of words moved at a time between copies of the service data */
+#define SERVICE_DATA_COPY_WORDS     (8)
+
+/*=============================================================================
+ *  Private Data
+ *============================================================================*/
+/* The bond table, as stored in NVM */
+static BOND_ENTRY_T bond_table[BOND_TABLE_SIZE];
+
+/* The entry in use by localData and the services */
+static uint16 current_host = 0;
+
+/* The largest 'last_used' in the table */
+static uint16 last_used = 0;
+
+/* The NVM offset of the first copy of the service data, and the size of
+ * each copy
+ */
+static uint16 service_data_offset;
+static uint16 service_data_words;
+
+/* All the hosts are in the whitelist */
+static bool whitelist_complete = FALSE;
+
+/*=============================================================================
+ *  Private Function Prototypes
+ *============================================================================*/
+static void writeEntry(uint16 host);
+static uint16 readServiceData(uint16 copy);
+static void copyServiceData(uint16 from, uint16 to);
+static void selectHost(uint16 host);
+static uint16 mostRecentHost(void);
+static uint16 nextLastUsed(void);
+static void markUsed(uint16 host);
+static bool sameHost(BOND_ENTRY_T *p_entry, BOND_ENTRY_T *p_other);
+
+/*=============================================================================
+ *  Private Function Implementations
+ *============================================================================*/
+/*-----------------------------------------------------------------------------*
+ *  NAME
+ *      writeEntry
+ *
+ *  DESCRIPTION
+ *      Write an entry of the bond table to NVM.
+ *----------------------------------------------------------------------------*/
+static void writeEntry(uint16 host)
+{
+    Nvm_Write((uint16*)&bond_table[host],
+              sizeof(BOND_ENTRY_T),
+              BOND_ENTRY_NVM_OFFSET(host));
+}
+
+/*-----------------------------------------------------------------------------*
+ *  NAME
+ *      readServiceData
+ *
+ *  DESCRIPTION
+ *      Point the services at a copy of the service data in NVM (that of a
+ *      host, or PAIRING_SERVICE_DATA), and read it if the remote is bonded
+ *      (otherwise the services initialise it).
+ *
+ *  RETURNS
+ *      The NVM offset following the copy of the service data.
+ *----------------------------------------------------------------------------*/
+static uint16 readServiceData(uint16 copy)
+{
+    uint16 offset = service_data_offset + (copy * service_data_words);
+
+    /* Read/write GATT data to/from NVM */
+    GattReadDataFromNVM(&offset);
+
+    /* Read HID service data from NVM if the devices are bonded */
+    HidReadDataFromNVM(localData.bonded, &offset);
+
+    /* Read Battery service data from NVM if the devices are bonded */
+    BatteryReadDataFromNVM(localData.bonded, &offset);
+
+    return offset;
+}
+
+/*-----------------------------------------------------------------------------*
+ *  NAME
+ *      copyServiceData
+ *
+ *  DESCRIPTION
+ *      Copy one copy of the service data in NVM over another.
+ *----------------------------------------------------------------------------*/
+static void copyServiceData(uint16 from, uint16 to)
+{
+    uint16 buffer[SERVICE_DATA_COPY_WORDS];
+    uint16 done;
+    uint16 words;
+
+    for(done = 0; done < service_data_words; done += words)
+    {
+        words = service_data_words - done;
+
+        if(words > SERVICE_DATA_COPY_WORDS)
+        {
+            words = SERVICE_DATA_COPY_WORDS;
+        }
+
+        Nvm_Read(buffer, words,
+                 service_data_offset + (from * service_data_words) + done);
+        Nvm_Write(buffer, words,
+                  service_data_offset + (to * service_data_words) + done);
+    }
+}
+
+/*-----------------------------------------------------------------------------*
+ *  NAME
+ *      selectHost
+ *
+ *  DESCRIPTION
+ *      Make an entry of the bond table the current host: copy its bonding
+ *      information to localData and read its service data. A free entry
+ *      leaves the remote not bonded, using the pairing copy of the service
+ *      data.
+ *----------------------------------------------------------------------------*/
+static void selectHost(uint16 host)
+{
+    current_host = host;
+
+    localData.bonded = (bond_table[host].last_used != 0);
+    localData.bonded_bd_addr = bond_table[host].bd_addr;
+    localData.diversifier = bond_table[host].diversifier;
+    localData.central_device_irk = bond_table[host].irk;
+
+    (void)readServiceData(localData.bonded ? host : PAIRING_SERVICE_DATA);
+
+#if defined(FAST_RECONNECT)
+    /* The host to reconnect to may have changed */
+    AdvPrepareDirected();
+#endif /* FAST_RECONNECT */
+}
+
+/*-----------------------------------------------------------------------------*
+ *  NAME
+ *      mostRecentHost
+ *
+ *  DESCRIPTION
+ *      Find the most recently used entry of the bond table.
+ *
+ *  RETURNS
+ *      The index of the entry (a free entry if there are no hosts).
+ *----------------------------------------------------------------------------*/
+static uint16 mostRecentHost(void)
+{
+    uint16 host;
+    uint16 recent = 0;
+
+    for(host = 1; host < BOND_TABLE_SIZE; host++)
+    {
+        if(bond_table[host].last_used > bond_table[recent].last_used)
+        {
+            recent = host;
+        }
+    }
+
+    return recent;
+}
+
+/*-----------------------------------------------------------------------------*
+ *  NAME
+ *      nextLastUsed
+ *
+ *  DESCRIPTION
+ *      Get the 'last_used' value for the host being used now. Once the
+ *      values run out, the hosts are renumbered from 1 (keeping their order)
+ *      and the table is written back to NVM.
+ *
+ *  RETURNS
+ *      The 'last_used' value, larger than that of any other entry.
+ *----------------------------------------------------------------------------*/
+static uint16 nextLastUsed(void)
+{
+    if(last_used == BOND_LAST_USED_MAX)
+    {
+        uint16 rank[BOND_TABLE_SIZE];
+        uint16 host;
+        uint16 other;
+
+        last_used = 0;
+
+        for(host = 0; host < BOND_TABLE_SIZE; host++)
+        {
+            rank[host] = 0;
+
+            if(bond_table[host].last_used != 0)
+            {
+                /* Count the hosts used before this one (and this one) */
+                for(other = 0; other < BOND_TABLE_SIZE; other++)
+                {
+                    if((bond_table[other].last_used != 0) &&
+                       (bond_table[other].last_used <=
+                                                bond_table[host].last_used))
+                    {
+                        rank[host]++;
+                    }
+                }
+
+                last_used++;
+            }
+        }
+
+        for(host = 0; host < BOND_TABLE_SIZE; host++)
+        {
+            bond_table[host].last_used = rank[host];
+        }
+
+        Nvm_Write((uint16*)bond_table, BOND_TABLE_NVM_WORDS,
+                  NVM_OFFSET_BOND_TABLE);
+    }
+
+    return ++last_used;
+}
+
+/*-----------------------------------------------------------------------------*
+ *  NAME
+ *      markUsed
+ *
+ *  DESCRIPTION
+ *      Record that a host (in the table) is being used. NVM is only written
+ *      if it was not already the most recently used host.
+ *----------------------------------------------------------------------------*/
+static void markUsed(uint16 host)
+{
+    if(bond_table[host].last_used != last_used)
+    {
+        bond_table[host].last_used = nextLastUsed();
+
+        /* 'last_used' is the first word of the entry */
+        Nvm_Write(&bond_table[host].last_used,
+                  sizeof(bond_table[host].last_used),
+                  BOND_ENTRY_NVM_OFFSET(host));
+    }
+}
+
+/*-----------------------------------------------------------------------------*
+ *  NAME
+ *      sameHost
+ *
+ *  DESCRIPTION
+ *      Check whether two entries of the bond table are for the same host. A
+ *      host using a resolvable random address is known by its IRK, any other
+ *      host by its address.
+ *
+ *  RETURNS
+ *      TRUE if the entries are for the same host.
+ *----------------------------------------------------------------------------*/
+static bool sameHost(BOND_ENTRY_T *p_entry, BOND_ENTRY_T *p_other)
+{
+    if(IsAddressResolvableRandom(&p_entry->bd_addr))
+    {
+        return (IsAddressResolvableRandom(&p_other->bd_addr) &&
+                (MemCmp(p_entry->irk.irk, p_other->irk.irk,
+                        MAX_WORDS_IRK) == 0));
+    }
+
+    return (MemCmp(&p_entry->bd_addr, &p_other->bd_addr,
+                   sizeof(TYPED_BD_ADDR_T)) == 0);
+}
+
+/*=============================================================================
+ *  Public Function Implementations
+ *============================================================================*/
+/*-----------------------------------------------------------------------------*
+ *  NAME
+ *      BondTableRead
+ *
+ *  DESCRIPTION
+ *      Read the bond table from NVM. BondTableInitServiceData() must be
+ *      called before the current host is used.
+ *----------------------------------------------------------------------------*/
+extern void BondTableRead(void)
+{
+    Nvm_Read((uint16*)bond_table, BOND_TABLE_NVM_WORDS, NVM_OFFSET_BOND_TABLE);
+
+    last_used = bond_table[mostRecentHost()].last_used;
+}
+
+/*-----------------------------------------------------------------------------*
+ *  NAME
+ *      BondTableErase
+ *
+ *  DESCRIPTION
+ *      Forget all the hosts, in NVM as well. Used when the NVM is being
+ *      initialised.
+ *----------------------------------------------------------------------------*/
+extern void BondTableErase(void)
+{
+    MemSet(bond_table, 0, BOND_TABLE_NVM_WORDS);
+    last_used = 0;
+
+    Nvm_Write((uint16*)bond_table, BOND_TABLE_NVM_WORDS, NVM_OFFSET_BOND_TABLE);
+}
+
+/*-----------------------------------------------------------------------------*
+ *  NAME
+ *      BondTableInitServiceData
+ *
+ *  DESCRIPTION
+ *      Set out the copies of the service data of the hosts in NVM, starting
+ *      at the given offset, and select the most recently used host.
+ *
+ *  PARAMETERS
+ *      p_offset [in/out]       NVM offset, advanced past the service data
+ *----------------------------------------------------------------------------*/
+extern void BondTableInitServiceData(uint16 *p_offset)
+{
+    service_data_offset = *p_offset;
+
+    /* The services advance the offset by the NVM they use, so lay out the
+     * first copy to find the size of each.
+     */
+    service_data_words = 0;
+    localData.bonded = (bond_table[0].last_used != 0);
+    service_data_words = readServiceData(0) - service_data_offset;
+
+    *p_offset += ((BOND_TABLE_SIZE + 1) * service_data_words);
+
+    BondTableSelectRecent();
+}
+
+/*-----------------------------------------------------------------------------*
+ *  NAME
+ *      BondTableSelectRecent
+ *
+ *  DESCRIPTION
+ *      Make the most recently used host the current host. localData.bonded
+ *      is FALSE afterwards only if the table is empty.
+ *----------------------------------------------------------------------------*/
+extern void BondTableSelectRecent(void)
+{
+    selectHost(mostRecentHost());
+}
+
+/*-----------------------------------------------------------------------------*
+ *  NAME
+ *      BondTableSelectHost
+ *
+ *  DESCRIPTION
+ *      Find the host that has connected from the given address, and make it
+ *      the current (and most recently used) host. The current host is tried
+ *      first, so that resolving a private address normally takes one go.
+ *
+ *  RETURNS
+ *      TRUE if the host is in the table, FALSE if it is not (the current
+ *      host is unchanged).
+ *----------------------------------------------------------------------------*/
+extern bool BondTableSelectHost(TYPED_BD_ADDR_T *p_addr)
+{
+    const bool resolvable = IsAddressResolvableRandom(p_addr);
+    uint16 i;
+
+    for(i = 0; i < BOND_TABLE_SIZE; i++)
+    {
+        const uint16 host = (current_host + i) % BOND_TABLE_SIZE;
+        BOND_ENTRY_T *p_entry = &bond_table[host];
+
+        if(p_entry->last_used == 0)
+        {
+            continue;
+        }
+
+        if(resolvable ?
+           (IsAddressResolvableRandom(&p_entry->bd_addr) &&
+            (SMPrivacyMatchAddress(p_addr,
+                                   p_entry->irk.irk,
+                                   MAX_NUMBER_IRK_STORED,
+                                   MAX_WORDS_IRK) >= 0)) :
+           (MemCmp(p_addr, &p_entry->bd_addr, sizeof(TYPED_BD_ADDR_T)) == 0))
+        {
+            if(host != current_host)
+            {
+                selectHost(host);
+            }
+
+            markUsed(host);
+
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
+/*-----------------------------------------------------------------------------*
+ *  NAME
+ *      BondTableNewHost
+ *
+ *  DESCRIPTION
+ *      Get ready to pair with a new host: the remote is no longer bonded and
+ *      the services use the pairing copy of the service data. The table is
+ *      not changed; BondTableAddHost() finds the new host an entry, and
+ *      BondTableSelectRecent() goes back to the hosts if no host pairs.
+ *----------------------------------------------------------------------------*/
+extern void BondTableNewHost(void)
+{
+    localData.bonded = FALSE;
+
+    (void)readServiceData(PAIRING_SERVICE_DATA);
+
+#if defined(FAST_RECONNECT)
+    /* There is no host to reconnect to */
+    AdvPrepareDirected();
+#endif /* FAST_RECONNECT */
+}
+
+/*-----------------------------------------------------------------------------*
+ *  NAME
+ *      BondTableAddHost
+ *
+ *  DESCRIPTION
+ *      Pairing has completed: store the bonding information in localData
+ *      (bonded_bd_addr, diversifier and central_device_irk) in the bond table
+ *      and make it the current, most recently used host. A host that has
+ *      paired again replaces its old entry; otherwise a free entry is used,
+ *      and only if there is none is the least recently used host forgotten.
+ *      The service data written while pairing is moved to the entry's copy.
+ *----------------------------------------------------------------------------*/
+extern void BondTableAddHost(void)
+{
+    BOND_ENTRY_T entry;
+    uint16 host;
+    uint16 slot = BOND_TABLE_SIZE;
+    uint16 oldest = 0;
+
+    MemSet(&entry, 0, sizeof(BOND_ENTRY_T));
+    entry.bd_addr = localData.bonded_bd_addr;
+    entry.diversifier = localData.diversifier;
+
+    if(IsAddressResolvableRandom(&entry.bd_addr))
+    {
+        entry.irk = localData.central_device_irk;
+    }
+
+    for(host = 0; host < BOND_TABLE_SIZE; host++)
+    {
+        if((bond_table[host].last_used != 0) &&
+           sameHost(&entry, &bond_table[host]))
+        {
+            /* The host has paired again; its old keys are no longer valid */
+            slot = host;
+            break;
+        }
+
+        /* A free entry has the smallest 'last_used' of all */
+        if(bond_table[host].last_used < bond_table[oldest].last_used)
+        {
+            oldest = host;
+        }
+    }
+
+    if(slot == BOND_TABLE_SIZE)
+    {
+        slot = oldest;
+    }
+
+    bond_table[slot] = entry;
+    bond_table[slot].last_used = nextLastUsed();
+    writeEntry(slot);
+
+    copyServiceData(PAIRING_SERVICE_DATA, slot);
+
+    current_host = slot;
+    (void)readServiceData(slot);
+}
+
+/*-----------------------------------------------------------------------------*
+ *  NAME
+ *      BondTableUpdateWhiteList
+ *
+ *  DESCRIPTION
+ *      Add the addresses of all the hosts to the whitelist (which the caller
+ *      has reset). Hosts using private addresses cannot be added.
+ *----------------------------------------------------------------------------*/
+extern void BondTableUpdateWhiteList(void)
+{
+    uint16 host;
+
+    whitelist_complete = TRUE;
+
+    for(host = 0; host < BOND_TABLE_SIZE; host++)
+    {
+        TYPED_BD_ADDR_T *p_addr = &bond_table[host].bd_addr;
+
+        if(bond_table[host].last_used == 0)
+        {
+            continue;
+        }
+
+        if(IsAddressResolvableRandom(p_addr) ||
+           IsAddressNonResolvableRandom(p_addr) ||
+           (LsAddWhiteListDevice(p_addr) != ls_err_none))
+        {
+            whitelist_complete = FALSE;
+        }
+    }
+}
+
+/*-----------------------------------------------------------------------------*
+ *  NAME
+ *      BondTableWhiteListComplete
+ *
+ *  DESCRIPTION
+ *      Check whether the whitelist holds all the hosts, so that undirected
+ *      advertisements can be restricted to it.
+ *
+ *  RETURNS
+ *      TRUE if all the hosts were added by BondTableUpdateWhiteList().
+ *----------------------------------------------------------------------------*/
+extern bool BondTableWhiteListComplete(void)
+{
+    return whitelist_complete;
+}
+
+/*-----------------------------------------------------------------------------*
+ *  NAME
+ *      BondTableOnOtaSwitch
+ *
+ *  DESCRIPTION
+ *      The application is about to be switched, so the GATT database may be
+ *      different after the device has reset. Record this for every host, so
+ *      that each is told when it next connects.
+ *----------------------------------------------------------------------------*/
+extern void BondTableOnOtaSwitch(void)
+{
+    const uint16 current = current_host;
+    const bool bonded = localData.bonded;
+    uint16 host;
+
+    for(host = 0; host < BOND_TABLE_SIZE; host++)
+    {
+        if(bond_table[host].last_used != 0)
+        {
+            selectHost(host);
+            GattOnOtaSwitch();
+        }
+    }
+
+    selectHost(current);
+
+    if(!bonded)
+    {
+        /* Pairing: go back to the pairing copy of the service data */
+        BondTableNewHost();
+    }
+}
+
+/*-----------------------------------------------------------------------------*
+ *  NAME
+ *      BondTableCurrentHost
+ *
+ *  RETURNS
+ *      The index of the current host's entry in the bond table.
+ *----------------------------------------------------------------------------*/
+extern uint16 BondTableCurrentHost(void)
+{
+    return current_host;
+}
@@ -0,0 +1,103 @@
+/*******************************************************************************
+ *    Copyright (C) Cambridge Silicon Radio Limited 2015
+ *
+ * FILE
+ *    bond_table.h
+ *
+ *  DESCRIPTION
+ *    Header file for the bond table. The remote can be bonded to up to
+ *    BOND_TABLE_SIZE hosts. Each host has an entry in NVM (address,
+ *    diversifier and IRK), followed by its own copy of the service data
+ *    (the GATT, HID and Battery client configurations), so that moving
+ *    between hosts only costs a reconnection.
+ *
+ *    One entry at a time is the current host: its bonding information is
+ *    held in localData (bonded, bonded_bd_addr, diversifier and
+ *    central_device_irk) and the services use its copy of the service data.
+ *
+ ******************************************************************************/
+#ifndef _BOND_TABLE_H
+#define _BOND_TABLE_H
+
+/*=============================================================================
+ *  SDK Header Files
+ *============================================================================*/
+#include <types.h>
+#include <bluetooth.h>
+
+/*=============================================================================
+ *  Local Header Files
+ *============================================================================*/
+#include "configuration.h"
+#include "remote.h"
+
+/*=============================================================================
+ *  Public Definitions
+ *============================================================================*/
+
+/* The number of hosts the remote can be bonded to */
+#ifndef BOND_TABLE_SIZE
+#define BOND_TABLE_SIZE             (1)
+#endif /* BOND_TABLE_SIZE */
+
+/* Per-host flags are kept as one bit per entry in a uint16. The NVM is
+ * normally the tighter limit (see N_TOTAL_NVM_WORDS in remote.c).
+ */
+#if BOND_TABLE_SIZE > 16
+#error "BOND_TABLE_SIZE must be 16 or less"
+#endif /* BOND_TABLE_SIZE > 16 */
+
+/* One entry of the bond table, as stored in NVM */
+typedef struct
+{
+    /* When the host was last connected to, as a count that goes up with each
+     * connection to a different host. Zero if the entry is not in use.
+     */
+    uint16 last_used;
+
+    /* The address of the host */
+    TYPED_BD_ADDR_T bd_addr;
+
+    /* Diversifier associated with the LTK of the host */
+    uint16 diversifier;
+
+    /* The host's IRK (if it uses a resolvable random address) */
+    CENTRAL_DEVICE_IRK_T irk;
+
+} BOND_ENTRY_T;
+
+/* Number of words of NVM used by the bond table (the service data of the
+ * hosts is stored separately, see BondTableInitServiceData()).
+ */
+#define BOND_TABLE_NVM_WORDS        (BOND_TABLE_SIZE * sizeof(BOND_ENTRY_T))
+
+/*=============================================================================
+ *  Public function prototypes
+ *============================================================================*/
+
+/* Read the bond table from NVM */
+extern void BondTableRead(void);
+/* Forget all the hosts (NVM is being initialised) */
+extern void BondTableErase(void);
+/* Set out the service data of the hosts in NVM, and select the current host */
+extern void BondTableInitServiceData(uint16 *p_offset);
+/* Make the most recently used host the current host */
+extern void BondTableSelectRecent(void);
+/* Make the host with the given (connection) address the current host */
+extern bool BondTableSelectHost(TYPED_BD_ADDR_T *p_addr);
+/* Get ready to pair with a new host (not bonded), leaving the table as it is */
+extern void BondTableNewHost(void);
+/* Record the bonding information in localData as a host's entry, and make it
+ * the current host
+ */
+extern void BondTableAddHost(void);
+/* Add the addresses of all the hosts to the whitelist */
+extern void BondTableUpdateWhiteList(void);
+/* Whether the whitelist holds all the hosts (none uses a private address) */
+extern bool BondTableWhiteListComplete(void);
+/* The GATT database is about to change; tell all the hosts when they connect */
+extern void BondTableOnOtaSwitch(void);
+/* The index of the current host's entry */
+extern uint16 BondTableCurrentHost(void);
+
+#endif /* _BOND_TABLE_H */
@@ -16,6 +16,18 @@
 /* Enable the following define if loading large IR databases over HID. */
 /* #define ENABLE_IGNORE_CL_ON_OUTPUT_HID */
 
+/* Enable the following define to collect performance statistics (see
+ * perf_stats.h). The statistics are reported over the debug UART when
+ * DEBUG_ENABLE is also defined.
+ */
+/* #define PERF_STATS_ENABLE */
+
+/* Enable the following define to trace the events handled by the application
+ * (see event_trace.h). The trace is written to the debug UART when
+ * DEBUG_ENABLE is also defined.
+ */
+/* #define EVENT_TRACE_ENABLE */
+
 
 #if defined(MOTION_DATA_HILLCREST_FORMAT) && (!defined(ACCELEROMETER_PRESENT) && !defined(GYROSCOPE_PRESENT))
 #error "Airmouse support requires both an accelerometer and a gyroscope"
@@ -41,6 +53,31 @@
 
 /* This device disconnects from the Central after a period of inactivity */
 #define DISCONNECT_ON_IDLE          (1)
+/* Slave latency is turned off while keys are being pressed, so that whatever
+ * the host sends back (output reports, configuration writes) arrives within
+ * one connection interval rather than up to PREFERRED_SLAVE_LATENCY intervals
+ * later. It is turned back on after LINK_ACTIVE_HOLD_TIME without input.
+ * The cost shows in the PERF_STATS connection event count and energy
+ * estimate; the host's reply latency is not measured on target.
+ */
+#define LINK_ACTIVITY_LOW_LATENCY
+#define LINK_ACTIVE_HOLD_TIME       (1 * SECOND)
+/* Reconnection to the bonded host is made as quick as possible: the directed
+ * advertising set-up is prepared when the bond changes rather than on each
+ * wake-up, and the keys pressed while disconnected are sent as soon as the
+ * link is encrypted if the host is known to keep its notification
+ * subscriptions across connections. PERF_STATS measures the effect in the
+ * key latency of the idle and reconnection-delay categories.
+ */
+#define FAST_RECONNECT
+/* The number of hosts the remote can be bonded to. Pairing with another host
+ * when all are in use forgets the least recently used one, once the pairing
+ * has completed. Each host takes 23 words of NVM (its bond table entry and
+ * service data), and the build fails if the NVM layout does not fit in
+ * NVM_SIZE (128 words, see the .keyr files): 4 hosts fit with the default
+ * options, but not with both __GAP_PRIVACY_SUPPORT__ and an IR protocol.
+ */
+#define BOND_TABLE_SIZE             (4)
 /* Parameters for InvenSense gesture detection */
 #define GESTURE_SWIPE_MIN_DIST      (500)
 #define GESTURE_SWIPE_MAX_NOISE     (300)
@@ -54,18 +91,41 @@
 #define PIO_CONTROLLER_BIT_MASK		(0x1fe00000UL)
 /* The PIOs used specifically in the key-scan matrix: */
 #define KEY_MATRIX_PIO_BIT_MASK		(0x1fe00000UL)
+/* The key-matrix rows (PIOs 21-23) and columns (PIOs 24-28): */
+#define KEY_MATRIX_ROW_PIO_MASK		(0x00e00000UL)
+#define KEY_MATRIX_COLUMN_PIO_MASK	(0x1f000000UL)
+
+/* Stop the PIO controller while no key is held down. All the rows are driven
+ * low and a falling edge on any column wakes the XAP, which restarts
+ * key-scanning until every key has been released again.
+ */
+#define KEYSCAN_IDLE_EDGE_WAKE
 
 /* PIO INITIALISATION */
 #define PIOS_TO_PULL_HIGH           (0xe01ffdffUL)  /* These PIOs specifically need to be pulled high */
 #define PIOS_TO_PULL_LOW            (0x00000200UL)  /* These PIOs specifically need to be pulled low */
 
 /* Some definitions related to the PIO controller code */
-#define USE_SECOND_DATA_BANK        (0x01)
 #define BUTTON_VALID                (0x02)
 #define WHEEL_VALID                 (0x04)
 #define AUDIO_VALID                 (0x08)
 #define AUDIO_BUTTON_RELEASE_VALID  (0x10)
 
+/* Key-scan debounce. A change in the key matrix is only reported by the PIO
+ * controller once it has been seen on (KEYSCAN_DEBOUNCE_DEPTH + 1)
+ * consecutive scans; 0 reports changes immediately. Maximum 255.
+ */
+#define KEYSCAN_DEBOUNCE_DEPTH      (2)
+
+/* Look keys up in the dense RemoteKeyMatrix (8 entries per row) rather than
+ * through the sparse per-row table that keyscanInit() builds from it. The
+ * sparse look-up compacts the matrix to the keys that are fitted, at the cost
+ * of a bit-count per look-up and one word per row. Its speed has not been
+ * measured on target: compare the PERF_STATS system event time ("perf ev")
+ * with and without this option over the same key presses.
+ */
+/* #define KEYSCAN_DENSE_KEY_MATRIX */
+
 /******************************************************************************
  * Macros related to the clearing paired-device information
  ******************************************************************************/
@@ -91,20 +151,91 @@
  */
 #define CLEAR_PAIRING_DUAL_PURPOSE
 
+/******************************************************************************
+ * Macros related to key auto-repeat
+ ******************************************************************************/
+
+/* Some hosts do not repeat a held key themselves, but expect the remote to send
+ * the report again. With auto-repeat, a held key is reported again after a
+ * delay and then periodically, at a rate set for its class of key. A repeat
+ * still waiting in the notification queue is replaced by the next one, so a
+ * held key never has more than one repeat queued however slow the link.
+ *
+ * To disable key auto-repeat, comment out the following line:
+ */
+#define KEY_AUTO_REPEAT
+
+/* The delay before the first repeat and the repeat period, for each class of
+ * key (see the gesture table in key_scan.c for the keys in each class).
+ */
+#define KEY_REPEAT_VOLUME_DELAY         (400 * MILLISECOND)
+#define KEY_REPEAT_VOLUME_PERIOD        (100 * MILLISECOND)
+#define KEY_REPEAT_NAVIGATION_DELAY     (500 * MILLISECOND)
+#define KEY_REPEAT_NAVIGATION_PERIOD    (150 * MILLISECOND)
+
+/******************************************************************************
+ * Macros related to sending notifications
+ ******************************************************************************/
+
+/* The number of notifications that may be handed to the firmware before the
+ * first of them is confirmed, so that a burst of reports can go out in one
+ * connection event. This must not exceed the number of notifications the
+ * firmware can hold for transmission; 1 sends one notification at a time.
+ */
+#define NOTIFICATION_WINDOW                 (4)
+
+/* Input reports still waiting to be sent when they are this old (e.g. keys
+ * pressed during a reconnection) are dropped if two later reports from the
+ * same key group supersede them. The last two reports (normally the newest
+ * press and release) are always sent, so the key that woke the remote is not
+ * lost and the host ends up with the right keys held.
+ */
+#define KEY_REPORT_MAX_AGE                  (300 * MILLISECOND)
+
+/* Notifications buffered while earlier ones are still awaiting confirmation
+ * are sent together just before the next connection event (timed from the
+ * radio events), rather than one at a time as each confirmation arrives.
+ * A notification buffered while none is in flight is always sent at once.
+ * This costs two wake-ups per batch (radio event and timer); it only pays
+ * if confirmations do not already arrive in time to refill the firmware
+ * before the next connection event. Whether it does has not been measured
+ * on target: compare the PERF_STATS "batch=" and "batched=" counts against
+ * "sent", and the energy estimate, with and without this option.
+ */
+/* #define NOTIFICATION_BATCHING */
+
 /******************************************************************************
  * Macros related to the HID service. These should not normally be changed.
  ******************************************************************************/
 
-/* Inputs report IDs */
+/* Inputs report IDs. No two reports may share an ID (service_hid.c checks
+ * this). The Report Reference descriptors in the GATT database hold the ID
+ * in the high byte and the report type in the low byte (0x0101 is ID 1,
+ * Input), so they must be kept in step with these values.
+ */
 #define HID_CONSUMER_REPORT_ID              (1)
-#define HID_KEYBOARD_REPORT_ID              (2)
+#define HID_KEYBOARD_REPORT_ID              (3)
 #define HID_MOTION_REPORT_ID                (9)
 #define HID_MOUSE_REPORT_ID                 (6)
 #define HID_AUDIO_INPUT_REPORT_ID           (30)
+/* The Battery level, referenced from the HID service (service_battery_db.db) */
+#define HID_BATTERY_REPORT_ID               (2)
 
 /* The length of the keypress data in bytes. */
 #define HID_KEYPRESS_DATA_LENGTH            (2)
 
+/* Keys on the Keyboard page (KEYBOARD_KEY() in the key matrix) are sent in a
+ * 6-key rollover keyboard report (HID_KEYBOARD_REPORT_ID), so that keys held
+ * down together are reported together. The default key matrix has no
+ * Keyboard page keys, so the report (with its descriptor and client
+ * configuration) is left out unless this is defined. Defining it adds
+ * attributes to the HID service, which moves the later GATT handles.
+ */
+/* #define KEYBOARD_REPORT_PRESENT */
+
+/* The length of the keyboard report in bytes: modifiers, reserved, 6 keys. */
+#define HID_KEYBOARD_DATA_LENGTH            (8)
+
 /* Parser version (UINT16) - Version number of the base USB HID specification
  * Format - 0xJJMN (JJ - Major Version Number, M - Minor Version 
  *                  Number and N - Sub-minor version number)
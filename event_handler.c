@@ -23,6 +23,7 @@
  *============================================================================*/
 #include "remote.h"
 #include "nvm_access.h"
+#include "bond_table.h"
 #include "remote_gatt.h"
 #include "event_handler.h"
 #include "advertise.h"
@@ -35,18 +36,38 @@
 #include "service_csr_ota.h"
 #include "motion.h"
 #include "mouse.h"
+#include "perf_stats.h"
+#include "event_trace.h"
 
 /*=============================================================================
  *  Private Definitions
  *============================================================================*/
 /* Time after which a L2CAP connection parameter update request will be
- * re-sent upon failure of an earlier sent request.
- * Due to using the watchdog clock (with a 15-second resolution) as the time 
- * source, the actual timeout value could be up to 15-seconds later than the
- * time defined here.
+ * re-sent upon failure of an earlier sent request. This is the longest the
+ * retry delay grows to (see CONN_PARAM_RETRY_DELAY).
  */
 #define GAP_CONN_PARAM_TIMEOUT  (30 * SECOND)
 
+/* Delay before requesting the preferred connection parameters once the link
+ * is encrypted, or after the host has chosen other parameters.
+ */
+#define CONN_PARAM_UPDATE_DELAY (1 * SECOND)
+
+/* Delay before re-sending a failed connection parameter update request. It
+ * doubles with each failure, up to GAP_CONN_PARAM_TIMEOUT.
+ */
+#define CONN_PARAM_RETRY_DELAY  (2 * SECOND)
+
+/* The low-rate jobs run from the housekeeping timer */
+typedef enum {
+    HOUSEKEEPING_CONN_PARAM,    /* Request the preferred connection parameters */
+#if defined(LINK_ACTIVITY_LOW_LATENCY)
+    HOUSEKEEPING_LINK_ACTIVE,   /* Turn slave latency back on */
+#endif /* LINK_ACTIVITY_LOW_LATENCY */
+
+    HOUSEKEEPING_JOBS
+} HOUSEKEEPING_JOB;
+
 /* Despite being bonded, some Central devices re-subscribe to notifications
  * each time connection is established. When this happens, queued messages
  * (notifications) can be lost.
@@ -55,22 +76,185 @@
  */
 #define NOTIFICATION_DELAY_AFTER_RECONNECTION      (200*MILLISECOND)
 
+#if defined(FAST_RECONNECT)
+/* The bit of the current host (bond table entry) in host_resubscribes */
+#define CURRENT_HOST_BIT        (1U << BondTableCurrentHost())
+#endif /* FAST_RECONNECT */
+
 /*=============================================================================
  *  Private Data
  *============================================================================*/
+/* One timer serves all the housekeeping jobs; it runs until the earliest
+ * job due.
+ */
+static timer_id housekeeping_tid = TIMER_INVALID;
+/* When each job is due, and a bit per job that is scheduled */
+static uint32 housekeeping_due[HOUSEKEEPING_JOBS];
+static uint16 housekeeping_pending = 0;
 
+/* The delay before re-sending the next failed connection parameter update */
+static uint32 conn_param_retry_delay;
+
+/* A connection parameter update request fell due while the host was
+ * suspended; it is sent once the host exits suspend
+ */
+static bool conn_param_deferred = FALSE;
+
+#if defined(LINK_ACTIVITY_LOW_LATENCY)
+/* The time of the latest input activity */
+static uint32 link_activity_time;
+#endif /* LINK_ACTIVITY_LOW_LATENCY */
+
+#if defined(FAST_RECONNECT)
+/* The connection was made while bonded, so the host's notification
+ * subscriptions are already known (from NVM)
+ */
+static bool bonded_reconnection = FALSE;
+
+/* Whether each bonded host re-subscribes to notifications after reconnecting,
+ * a bit per bond table entry. Until a host has been seen not to, assume that
+ * it does.
+ */
+static uint16 host_resubscribes = 0xffff;
+#endif /* FAST_RECONNECT */
+
+/*=============================================================================
+ *  Private Function Prototypes
+ *============================================================================*/
+static void housekeepingTimerExpiry(timer_id tid);
 
 /*=============================================================================
  *  Private Function definitions
  *============================================================================*/
 
+/*-----------------------------------------------------------------------------*
+ *  NAME
+ *      housekeepingSchedule
+ *
+ *  DESCRIPTION
+ *      (Re)starts the housekeeping timer to expire when the earliest job
+ *      scheduled is due, or stops it if no job is scheduled.
+ *----------------------------------------------------------------------------*/
+static void housekeepingSchedule(void)
+{
+    uint32 now = TimeGet32();
+    uint32 delay = 0;
+    uint32 wait;
+    bool scheduled = FALSE;
+    uint16 job;
+
+    TimerDelete(housekeeping_tid);
+    housekeeping_tid = TIMER_INVALID;
+
+    for(job = 0; job < HOUSEKEEPING_JOBS; job++)
+    {
+        if(housekeeping_pending & (1 << job))
+        {
+            /* A job already due runs at once */
+            wait = ((int32)(housekeeping_due[job] - now) > 0) ?
+                   (housekeeping_due[job] - now) : 0;
+
+            if(!scheduled || (wait < delay))
+            {
+                delay = wait;
+                scheduled = TRUE;
+            }
+        }
+    }
+
+    if(scheduled)
+    {
+        housekeeping_tid = TimerCreate(delay, TRUE, housekeepingTimerExpiry);
+    }
+}
+
+/*-----------------------------------------------------------------------------*
+ *  NAME
+ *      housekeepingStart
+ *
+ *  DESCRIPTION
+ *      Schedules a housekeeping job to run after the given delay, replacing
+ *      any earlier schedule for it.
+ *----------------------------------------------------------------------------*/
+static void housekeepingStart(HOUSEKEEPING_JOB job, uint32 delay)
+{
+    housekeeping_due[job] = TimeGet32() + delay;
+    housekeeping_pending |= (1 << job);
+    housekeepingSchedule();
+}
+
+/*-----------------------------------------------------------------------------*
+ *  NAME
+ *      housekeepingStop
+ *
+ *  DESCRIPTION
+ *      Cancels a housekeeping job (if scheduled).
+ *----------------------------------------------------------------------------*/
+static void housekeepingStop(HOUSEKEEPING_JOB job)
+{
+    if(housekeeping_pending & (1 << job))
+    {
+        housekeeping_pending &= ~(1 << job);
+        housekeepingSchedule();
+    }
+}
+
+/*-----------------------------------------------------------------------------*
+ *  NAME
+ *      connParamsPreferred
+ *
+ *  DESCRIPTION
+ *      Returns TRUE if the link is using the preferred connection parameters.
+ *----------------------------------------------------------------------------*/
+static bool connParamsPreferred(void)
+{
+    return (localData.actual_interval >= PREFERRED_MIN_CON_INTERVAL) &&
+           (localData.actual_interval <= PREFERRED_MAX_CON_INTERVAL) &&
+           (localData.actual_latency == PREFERRED_SLAVE_LATENCY) &&
+           (localData.actual_timeout <= PREFERRED_SUPERVISION_TIMEOUT);
+}
+
+/*-----------------------------------------------------------------------------*
+ *  NAME
+ *      scheduleConnParamUpdate
+ *
+ *  DESCRIPTION
+ *      Schedules a connection parameter update request: the first of a new
+ *      series CONN_PARAM_UPDATE_DELAY from now, or the retry of a failed
+ *      request after a delay that doubles with each failure. No more than
+ *      MAX_NUM_CONN_PARAM_UPDATE_REQS are retried.
+ *----------------------------------------------------------------------------*/
+static void scheduleConnParamUpdate(bool newSeries)
+{
+    conn_param_deferred = FALSE;
+
+    if(newSeries)
+    {
+        localData.conn_param_update_count = 0;
+        conn_param_retry_delay = CONN_PARAM_RETRY_DELAY;
+        housekeepingStart(HOUSEKEEPING_CONN_PARAM, CONN_PARAM_UPDATE_DELAY);
+    }
+    else if(localData.conn_param_update_count <= MAX_NUM_CONN_PARAM_UPDATE_REQS)
+    {
+        housekeepingStart(HOUSEKEEPING_CONN_PARAM, conn_param_retry_delay);
+
+        conn_param_retry_delay <<= 1;
+        if(conn_param_retry_delay > GAP_CONN_PARAM_TIMEOUT)
+        {
+            conn_param_retry_delay = GAP_CONN_PARAM_TIMEOUT;
+        }
+    }
+}
+
 /*-----------------------------------------------------------------------------*
  *  NAME
  *      requestConnParamUpdate
  *
  *  DESCRIPTION
  *      This function is used to send L2CAP_CONNECTION_PARAMETER_UPDATE_REQUEST
- *      to the remote device when an earlier sent request had failed.
+ *      to the remote device, unless the link already uses the preferred
+ *      parameters. While the host is suspended the request is deferred
+ *      until it exits suspend (see handleHidExitSuspend()).
  *----------------------------------------------------------------------------*/
 static void requestConnParamUpdate(void)
 {
@@ -81,9 +265,7 @@ static void requestConnParamUpdate(void)
      */
     if(HidIsStateSuspended() == FALSE)
     {
-        if((localData.actual_latency > PREFERRED_SLAVE_LATENCY) ||
-           (localData.actual_timeout > PREFERRED_SUPERVISION_TIMEOUT) ||
-           (localData.actual_interval > PREFERRED_MAX_CON_INTERVAL))
+        if(!connParamsPreferred())
         {
             remote_pref_conn_params.con_max_interval =
                                         PREFERRED_MAX_CON_INTERVAL;
@@ -97,9 +279,12 @@ static void requestConnParamUpdate(void)
             (void)LsConnectionParamUpdateReq(&(localData.con_bd_addr), 
                                              &remote_pref_conn_params);
             localData.conn_param_update_count++;
-            localData.conn_param_counter_active = FALSE;
         }
     }
+    else
+    {
+        conn_param_deferred = TRUE;
+    }
 }
 
 /*-----------------------------------------------------------------------------*
@@ -107,13 +292,16 @@ static void requestConnParamUpdate(void)
  *      SendNextInputReport
  *
  *  DESCRIPTION
- *      If more motion data is available, send it now. Otherwise, drop out
- *      of MOTION state into IDLE state.
+ *      The next connection event is about to start. Send the batch of
+ *      notifications waiting (if any). If more motion data is available,
+ *      send it now. Otherwise, drop out of MOTION state into IDLE state.
  *----------------------------------------------------------------------------*/
 static void SendNextInputReport(timer_id tid)
 {
     localData.next_report_timer_id = TIMER_INVALID;
 
+    notificationSendBatch();
+
     if(localData.state & STATE_CONNECTED_MOTION)
     {
         /* Reception of radio_event_tx_data event indicates successful
@@ -167,12 +355,120 @@ static void handleBondingChanceTimerExpiry(timer_id tid)
  *----------------------------------------------------------------------------*/
 static void notificationConnectionDelay(timer_id tid)
 {
+#if defined(FAST_RECONNECT)
+    /* Learn whether the host re-subscribes, so that the next reconnection
+     * need not wait for this timer.
+     */
+    if(bonded_reconnection && (localData.state & STATE_CONNECTED))
+    {
+        if(HidIsClientConfigWritten())
+        {
+            host_resubscribes |= CURRENT_HOST_BIT;
+        }
+        else
+        {
+            host_resubscribes &= ~CURRENT_HOST_BIT;
+        }
+    }
+#endif /* FAST_RECONNECT */
+
     localData.blockNotifications = FALSE;
     
     /* Send the first queued notificaton (if any) */
     notificationSendNext();
 }
 
+#if defined(FAST_RECONNECT)
+/*-----------------------------------------------------------------------------*
+ *  NAME
+ *      keyReportsSubscribed
+ *
+ *  DESCRIPTION
+ *      Returns TRUE if the host has notifications enabled on any of the key
+ *      reports.
+ *----------------------------------------------------------------------------*/
+static bool keyReportsSubscribed(void)
+{
+#if defined(KEYBOARD_REPORT_PRESENT)
+    if(HidIsNotifyEnabledOnReportId(HID_KEYBOARD_REPORT_ID))
+    {
+        return TRUE;
+    }
+#endif /* KEYBOARD_REPORT_PRESENT */
+
+    return HidIsNotifyEnabledOnReportId(HID_CONSUMER_REPORT_ID);
+}
+#endif /* FAST_RECONNECT */
+
+#if defined(LINK_ACTIVITY_LOW_LATENCY)
+/*-----------------------------------------------------------------------------*
+ *  NAME
+ *      linkActiveExpiry
+ *
+ *  DESCRIPTION
+ *      Turns slave latency back on if there has been no input activity for
+ *      LINK_ACTIVE_HOLD_TIME. Otherwise the job is rescheduled for the rest
+ *      of the hold time, so that a key press costs a time-stamp rather than
+ *      a timer.
+ *----------------------------------------------------------------------------*/
+static void linkActiveExpiry(void)
+{
+    uint32 idle = TimeGet32() - link_activity_time;
+
+    if(idle < LINK_ACTIVE_HOLD_TIME)
+    {
+        housekeepingStart(HOUSEKEEPING_LINK_ACTIVE, LINK_ACTIVE_HOLD_TIME - idle);
+    }
+    else
+    {
+        handleLinkInactive();
+    }
+}
+#endif /* LINK_ACTIVITY_LOW_LATENCY */
+
+/*-----------------------------------------------------------------------------*
+ *  NAME
+ *      housekeepingTimerExpiry
+ *
+ *  DESCRIPTION
+ *      Runs the housekeeping jobs that are due, then restarts the timer for
+ *      the rest.
+ *----------------------------------------------------------------------------*/
+static void housekeepingTimerExpiry(timer_id tid)
+{
+    uint32 now = TimeGet32();
+    uint16 job;
+
+    housekeeping_tid = TIMER_INVALID;
+
+    for(job = 0; job < HOUSEKEEPING_JOBS; job++)
+    {
+        if((housekeeping_pending & (1 << job)) &&
+           ((int32)(housekeeping_due[job] - now) <= 0))
+        {
+            housekeeping_pending &= ~(1 << job);
+
+            switch(job)
+            {
+                case HOUSEKEEPING_CONN_PARAM:
+                    requestConnParamUpdate();
+                    break;
+
+#if defined(LINK_ACTIVITY_LOW_LATENCY)
+                case HOUSEKEEPING_LINK_ACTIVE:
+                    linkActiveExpiry();
+                    break;
+#endif /* LINK_ACTIVITY_LOW_LATENCY */
+
+                default:
+                    break;
+            }
+        }
+    }
+
+    housekeepingSchedule();
+}
+
 /*=============================================================================
  *  Public Function definitions
  *============================================================================*/
@@ -182,7 +478,8 @@ static void notificationConnectionDelay(timer_id tid)
  *      handleCreateReportTimer
  *
  *  DESCRIPTION
- *      Create the timer used to trigger transmission of motion data.
+ *      Create the timer used to trigger transmission of motion data and
+ *      batched notifications just before the next connection event.
  *
  *----------------------------------------------------------------------------*/
 extern void handleCreateReportTimer(void)
@@ -247,18 +544,16 @@ extern void handleCreateReportTimer(void)
  *----------------------------------------------------------------------------*/
 extern void handleClearPairing(void)
 {
-    localData.bonded = FALSE;
+    /* Get ready to pair with the next host. This clears localData.bonded;
+     * the bond table is only changed once a host has paired.
+     */
+    BondTableNewHost();
     
-    /* If the device was bonded earlier, remove it from whitelist */
+    /* Advertise to any host, not only those in the whitelist */
     AppUpdateWhiteList();
     
     /* We are not paired, so encryption cannot be enabled */
     localData.encrypt_enabled = FALSE;
-
-    /* Record the updated bonded status in the NVM */
-    Nvm_Write((uint16*)&localData.bonded,
-              sizeof(localData.bonded), 
-              NVM_OFFSET_BONDED_FLAG);
     
     /* Re-initialise service data */
     GapDataInit();
@@ -280,6 +575,77 @@ extern void handleResetIdleTimer(void)
 }
 #endif /* DISCONNECT_ON_IDLE */
 
+#if defined(LINK_ACTIVITY_LOW_LATENCY)
+/*-----------------------------------------------------------------------------*
+ *  NAME
+ *      handleLinkActivity
+ *
+ *  DESCRIPTION
+ *      This function is called on input activity. While connected (and the
+ *      host has not suspended), slave latency is turned off until there has
+ *      been no input for LINK_ACTIVE_HOLD_TIME. The firmware applies this at
+ *      the next connection event; unlike a connection parameter update, the
+ *      host has no say in it, so there is nothing to retry.
+ *----------------------------------------------------------------------------*/
+extern void handleLinkActivity(void)
+{
+    link_activity_time = TimeGet32();
+
+    if(localData.link_active ||
+       ((localData.state & STATE_CONNECTED) == 0) ||
+       HidIsStateSuspended())
+    {
+        return;
+    }
+
+    if(LsDisableSlaveLatency(TRUE) == ls_err_none)
+    {
+        perfEnergyCheckpoint();
+        localData.link_active = TRUE;
+        housekeepingStart(HOUSEKEEPING_LINK_ACTIVE, LINK_ACTIVE_HOLD_TIME);
+    }
+}
+
+/*-----------------------------------------------------------------------------*
+ *  NAME
+ *      handleLinkInactive
+ *
+ *  DESCRIPTION
+ *      This function turns slave latency back on (if input activity turned
+ *      it off). It is called when the activity stops, when the host suspends
+ *      and on leaving the connected states.
+ *----------------------------------------------------------------------------*/
+extern void handleLinkInactive(void)
+{
+    housekeepingStop(HOUSEKEEPING_LINK_ACTIVE);
+
+    if(localData.link_active)
+    {
+        perfEnergyCheckpoint();
+        localData.link_active = FALSE;
+        LsDisableSlaveLatency(FALSE);
+    }
+}
+#endif /* LINK_ACTIVITY_LOW_LATENCY */
+
+/*-----------------------------------------------------------------------------*
+ *  NAME
+ *      handleHidExitSuspend
+ *
+ *  DESCRIPTION
+ *      This function is called when the host exits suspend. A connection
+ *      parameter update request that fell due while it was suspended is sent
+ *      CONN_PARAM_UPDATE_DELAY later.
+ *----------------------------------------------------------------------------*/
+extern void handleHidExitSuspend(void)
+{
+    if(conn_param_deferred)
+    {
+        conn_param_deferred = FALSE;
+        housekeepingStart(HOUSEKEEPING_CONN_PARAM, CONN_PARAM_UPDATE_DELAY);
+    }
+}
+
 /*-----------------------------------------------------------------------------*
  *  NAME
  *      idleTimerHandler
@@ -296,7 +662,6 @@ extern void handleBackgroundTickInd(void)
      * However, we do not know when the first tick will arrive (*up to* 15 secs),
      * so add 1 to the result and be a little over rather than a little under.
      */
-    const uint8 connectionParamUpdateTicks = (GAP_CONN_PARAM_TIMEOUT / (15*SECOND)) + 1;
 #if defined(DISCONNECT_ON_IDLE)
     const uint8 disconnectionTimeoutTicks = (CONNECTED_IDLE_TIMEOUT_VALUE / (15*SECOND)) + 1;
     
@@ -319,20 +684,12 @@ extern void handleBackgroundTickInd(void)
         }
     }
 #endif /* DISCONNECT_ON_IDLE */
-    
-    /* If we are waiting to update the connection parameters and the counter
-     * expires (i.e., enough ticks have been received), request a change to the
-     * current connection parameters.
-     */
-    if(localData.conn_param_counter_active)
-    {
-        localData.conn_param_update_tick_count++;
-        
-        if(localData.conn_param_update_tick_count >= connectionParamUpdateTicks)
-        {
-            requestConnParamUpdate();
-        }
-    }
+
+    /* Periodically report the performance statistics */
+    perfBackgroundTick();
+
+    /* Write out the events traced since the last tick */
+    traceFlush();
 }
 
 /*-----------------------------------------------------------------------------*
@@ -373,16 +730,14 @@ extern void handleSignalGattConnectCfm(GATT_CONNECT_CFM_T* event_data)
                 localData.st_ucid = event_data->cid;
 
                 if(localData.bonded &&
-                   (IsAddressResolvableRandom(&localData.bonded_bd_addr) &&
-                    (SMPrivacyMatchAddress(&event_data->bd_addr,
-                                           localData.central_device_irk.irk,
-                                           MAX_NUMBER_IRK_STORED, 
-                                           MAX_WORDS_IRK) < 0)))
+                   !BondTableSelectHost(&event_data->bd_addr))
                 {
-                    /* The application is bonded to a remote device using 
-                     * resolvable random address and the application has failed 
-                     * to resolve the remote device address to which we just 
-                     * connected, so disconnect and start advertising again
+                    /* The application is bonded and the remote device to
+                     * which we just connected is not one of the bonded hosts
+                     * (its address is not a bonded host address, and does not
+                     * resolve with a bonded host IRK), so disconnect and start
+                     * advertising again. Otherwise the host is now the current
+                     * host.
                      */
                     stateSetDisconnect(ls_err_authentication);
                 }
@@ -394,6 +749,9 @@ extern void handleSignalGattConnectCfm(GATT_CONNECT_CFM_T* event_data)
                     {
                         GattOnConnection();
                     }
+#if defined(FAST_RECONNECT)
+                    bonded_reconnection = localData.bonded;
+#endif /* FAST_RECONNECT */
 
                     /* Security supported by the remote HID host */
                     
@@ -407,6 +765,11 @@ extern void handleSignalGattConnectCfm(GATT_CONNECT_CFM_T* event_data)
 
                     /* We are now connected, but not doing anything */
                     stateSet(STATE_CONNECTED_IDLE);
+
+                    /* The host's parameters are not known to be the
+                     * preferred ones until it reports them.
+                     */
+                    perfConnParams(connParamsPreferred());
                     
                     /* Trigger sending any buffered key-presses */
                     if(TimerCreate(NOTIFICATION_DELAY_AFTER_RECONNECTION, 
@@ -459,43 +822,68 @@ extern void handleSignalGattCancelConnectCfm(void)
     /* GATT_CANCEL_CONNECT_CFM is received when undirected advertisements
      * are stopped.
      */
-    if (localData.state == STATE_FAST_ADVERT)
+    if((localData.state == STATE_FAST_ADVERT) ||
+       (localData.state == STATE_SLOW_ADVERT))
     {
         if(localData.pairing_button_pressed)
         {
+            /* The user wants to re-pair this remote control. */
+            
             /* Reset and clear the whitelist */
             handleClearPairing();
 
             localData.pairing_button_pressed = FALSE;
-            
-            /* Stay in fast-advertising state.
-             * Re-trigger advertising.
-             */
-            AdvStart(TRUE, gap_mode_connect_undirected);
+            localData.adv_restart = FALSE;
+
+            /* Start fast advertising from the first stage */
+            localData.adv_stage = 0;
+
+            if(localData.state == STATE_FAST_ADVERT)
+            {
+                /* Stay in fast-advertising state.
+                 * Re-trigger advertising.
+                 */
+                AdvStart(0, gap_mode_connect_undirected);
+            }
+            else
+            {
+                stateSet(STATE_FAST_ADVERT);
+            }
         }
-        else
+        else if(localData.adv_restart)
         {
-            /* Switch to slow advertising to save power */
-            stateSet(STATE_SLOW_ADVERT);
+            /* Following user activity, start the advertising schedule again
+             * (with directed advertisements, if bonded).
+             */
+            stateSet(STATE_ADVERTISING);
         }
-    }
-    else if(localData.state == STATE_SLOW_ADVERT)
-    {
-        if(localData.pairing_button_pressed)
+        else if((localData.adv_stage + 1) < ADV_SCHEDULE_STAGES)
         {
-            /* The user wants to re-pair this remote control. */
-            
-            /* Reset and clear the whitelist */
-            handleClearPairing();
+            /* Move on to the next stage of the advertising schedule */
+            localData.adv_stage++;
 
-            localData.pairing_button_pressed = FALSE;
-        
-            /* Start fast advertising */
-            stateSet(STATE_FAST_ADVERT);
+            if(localData.adv_stage == (ADV_SCHEDULE_STAGES - 1))
+            {
+                /* Switch to slow advertising to save power */
+                stateSet(STATE_SLOW_ADVERT);
+            }
+            else
+            {
+                AdvStart(localData.adv_stage, gap_mode_connect_undirected);
+            }
         }
         else
         {
-            /* Slow undirected advertisements have been stopped. Device 
+            if(localData.bonded == FALSE)
+            {
+                /* No new host has paired, so go back to the bonded hosts (if
+                 * any), most recently used first.
+                 */
+                BondTableSelectRecent();
+                AppUpdateWhiteList();
+            }
+
+            /* The last stage of undirected advertisements has ended. Device 
              * shall move to IDLE state until next user activity or
              * pending notification.                     
              */
@@ -538,6 +926,18 @@ extern void handleSignalLmEvDisconnectComplete(HCI_EV_DATA_DISCONNECT_COMPLETE_T
 
     /* Don't try to send notifications if we're not connected. */
     localData.blockNotifications = TRUE;
+    notificationLinkLost();
+    notificationCancelBatch();
+
+#if defined(LINK_ACTIVITY_LOW_LATENCY)
+    /* The next connection starts with slave latency on */
+    handleLinkInactive();
+#endif /* LINK_ACTIVITY_LOW_LATENCY */
+
+    /* No more connection parameter update requests for this connection */
+    housekeepingStop(HOUSEKEEPING_CONN_PARAM);
+    conn_param_deferred = FALSE;
+    perfConnectionEnd();
 
 
     
@@ -622,17 +1022,14 @@ extern void handleSignalLMEncryptionChange(LM_EVENT_T *event_data)
                     TimerDelete(localData.recrypt_tid);
                     localData.recrypt_tid = TIMER_INVALID;
 
-                    /* Check whether the connection parameter update timer is running.
-                     * If not, start it to trigger the Connection Parameter Update 
-                     * procedure.
+                    /* Check whether a connection parameter update is scheduled.
+                     * If not, schedule one to trigger the Connection Parameter 
+                     * Update procedure.
                      */
-                    if(localData.conn_param_counter_active == FALSE)
+                    if((housekeeping_pending & (1 << HOUSEKEEPING_CONN_PARAM)) == 0)
                     {
-                        /* Reset the number of connection parameter update attempts */
-                        localData.conn_param_update_count = 0;
-                        /* Start timer to trigger Connection Paramter Update procedure */
-                        localData.conn_param_counter_active = TRUE;
-                    } /* Else at the expiry of timer Connection parameter 
+                        scheduleConnParamUpdate(TRUE);
+                    } /* Else when it is due the Connection parameter 
                        * update procedure will get triggered
                        */
                 
@@ -642,6 +1039,22 @@ extern void handleSignalLMEncryptionChange(LM_EVENT_T *event_data)
                      */
                     BatteryUpdateLevel(localData.st_ucid);
 
+#if defined(FAST_RECONNECT)
+                    /* A host that keeps its subscriptions will accept the
+                     * buffered key-presses now, so don't wait for
+                     * NOTIFICATION_DELAY_AFTER_RECONNECTION. The timer is left
+                     * running to check that the host still behaves this way.
+                     */
+                    if(bonded_reconnection &&
+                       !(host_resubscribes & CURRENT_HOST_BIT) &&
+                       localData.blockNotifications &&
+                       keyReportsSubscribed())
+                    {
+                        localData.blockNotifications = FALSE;
+                        notificationSendNext();
+                    }
+#endif /* FAST_RECONNECT */
+
                 }
             }
             break;
@@ -682,14 +1095,10 @@ extern void handleSignalSmKeysInd(SM_KEYS_IND_T *event_data)
 
             if(IsAddressResolvableRandom(&localData.con_bd_addr)) 
             {
+                /* It is stored in the bond table when pairing completes */
                 MemCopy(localData.central_device_irk.irk,
                         (event_data->keys)->irk,
                         MAX_WORDS_IRK);
-                
-                /* store IRK in NVM */
-                Nvm_Write(localData.central_device_irk.irk, 
-                          MAX_WORDS_IRK, 
-                          NVM_OFFSET_SM_IRK);
             }
             break;
         
@@ -718,19 +1127,17 @@ extern void handleSignalSmSimplePairingCompleteInd(SM_SIMPLE_PAIRING_COMPLETE_IN
                 localData.bonded = TRUE;
                 localData.bonded_bd_addr = event_data->bd_addr;
 
-                /* Store bonded host typed bd address to NVM */
-
-                /* Write one word bonded flag */
-                Nvm_Write((uint16*)&localData.bonded,
-                           sizeof(localData.bonded), 
-                           NVM_OFFSET_BONDED_FLAG);
+                /* Store the bonded host (typed bd address, diversifier and
+                 * IRK) in the bond table, as the most recently used host
+                 */
+                BondTableAddHost();
 
-                /* Write typed bd address of bonded host */
-                Nvm_Write((uint16*)&localData.bonded_bd_addr,
-                          sizeof(TYPED_BD_ADDR_T), 
-                          NVM_OFFSET_BONDED_ADDR);
+#if defined(FAST_RECONNECT)
+                /* Nothing is known yet about how this host reconnects */
+                host_resubscribes |= CURRENT_HOST_BIT;
+#endif /* FAST_RECONNECT */
 
-                /* White list is configured with the Bonded host address */
+                /* White list is configured with the Bonded host addresses */
                 AppUpdateWhiteList();
 
                 /* Send an updated battery level to the remote device */
@@ -802,11 +1209,10 @@ extern void handleSignalLsConnParamUpdateCfm(LS_CONNECTION_PARAM_UPDATE_CFM_T *e
         case STATE_CONNECTED_IDLE:
         case STATE_CONNECTED_MOTION:
         case STATE_CONNECTED_AUDIO:
-            if ((event_data->status != ls_err_none) && 
-                (localData.conn_param_update_count <= MAX_NUM_CONN_PARAM_UPDATE_REQS))
+            if(event_data->status != ls_err_none)
             {
-                localData.conn_param_update_tick_count = 0;
-                localData.conn_param_counter_active = TRUE;
+                /* Try again later (within the limit on attempts) */
+                scheduleConnParamUpdate(FALSE);
             }
             break;
         
@@ -838,11 +1244,8 @@ extern void handleSignalLsConnParamUpdateInd(LS_CONNECTION_PARAM_UPDATE_IND_T *p
                 p_event_data->conn_interval > PREFERRED_MAX_CON_INTERVAL ||
                 p_event_data->conn_latency < PREFERRED_SLAVE_LATENCY)
             {
-                /* Set the connection parameter update attempts counter to zero */
-                localData.conn_param_update_count = 0;
-                localData.conn_param_update_tick_count = 0;
-                /* Start timer to trigger Connection Paramter Update procedure */
-                localData.conn_param_counter_active = TRUE;
+                /* Start a new series of Connection Parameter Update requests */
+                scheduleConnParamUpdate(TRUE);
             }
             break;
 
@@ -868,9 +1271,11 @@ extern void handleConnectionUpdateInd(LM_EV_CONNECTION_UPDATE_T *event_data)
         case STATE_CONNECTED_MOTION:
         case STATE_CONNECTED_AUDIO:
             /* Connection parameters have been updated. */
+            perfEnergyCheckpoint();
             localData.actual_interval = event_data->data.conn_interval;
             localData.actual_latency = event_data->data.conn_latency;
             localData.actual_timeout = event_data->data.supervision_timeout;
+            perfConnParams(connParamsPreferred());
             break;
 
         default:
@@ -938,7 +1343,13 @@ extern void handleSignalLsRadioEventInd(void)
     
 #else
     
-    /* There is nothing to do here in this version of the Smart Remote. */
+    /* Send the notifications waiting (if any) just before the next
+     * connection event.
+     */
+    if(notificationBatchPending())
+    {
+        handleCreateReportTimer();
+    }
 
 #endif /* ACCELEROMETER_PRESENT || GYROSCOPE_PRESENT || TOUCHSENSOR_PRESENT */
 }
@@ -959,7 +1370,7 @@ extern void handleCharValIndCfm(GATT_CHAR_VAL_IND_CFM_T *cfm)
 {
     bool success = (cfm->result == sys_status_success);
 
-    notificationRegisterResult(success);
+    notificationRegisterResult(cfm->cid, cfm->handle, success);
     
     
     if(success)
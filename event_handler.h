@@ -28,6 +28,14 @@
 /* This function handles reseting the idle timer. */
 extern void handleResetIdleTimer(void);
 #endif /* DISCONNECT_ON_IDLE */
+#if defined(LINK_ACTIVITY_LOW_LATENCY)
+/* This function handles input activity (turning slave latency off). */
+extern void handleLinkActivity(void);
+/* This function handles the end of input activity (turning slave latency back on). */
+extern void handleLinkInactive(void);
+#endif /* LINK_ACTIVITY_LOW_LATENCY */
+/* This function handles the host exiting suspend. */
+extern void handleHidExitSuspend(void);
 /* This function handles the "background" tick being received from the FW. */
 extern void handleBackgroundTickInd(void);
 /* This function handles creating the timer used to trigger transmission of motion data. */
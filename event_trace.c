@@ -0,0 +1,343 @@
+/*******************************************************************************
+ *    Copyright (C) Cambridge Silicon Radio Limited 2013
+ *
+ * FILE
+ *    event_trace.c
+ *
+ *  DESCRIPTION
+ *    Records the firmware events handled by the application, with a
+ *    time-stamp and the payload fields that drive the application's
+ *    behaviour. Records are held in a ring buffer while events are being
+ *    handled, and written out later so that the UART output does not
+ *    disturb the timing being recorded: on the background tick, and from a
+ *    short timer (which runs once the events queued have been handled) as
+ *    soon as the buffer is half full. Records are only lost if more than
+ *    half a buffer's worth of events arrive before that timer can run.
+ *
+ *    Payload words recorded, by event:
+ *      GATT_CONNECT_CFM                result, cid
+ *      GATT_ACCESS_IND                 handle, flags, size_value
+ *      LM_EV_DISCONNECT_COMPLETE       reason
+ *      LM_EV_ENCRYPTION_CHANGE         status, enc_enable
+ *      LM_EV_CONNECTION_UPDATE         conn_interval, conn_latency,
+ *                                      supervision_timeout
+ *      LS_CONNECTION_PARAM_UPDATE_CFM  status
+ *      LS_CONNECTION_PARAM_UPDATE_IND  conn_interval, conn_latency,
+ *                                      supervision_timeout
+ *      SM_SIMPLE_PAIRING_COMPLETE_IND  status
+ *      SM_DIV_APPROVE_IND              div
+ *      GATT_CHAR_VAL_NOT_CFM and
+ *      GATT_CHAR_VAL_IND_CFM           result, handle
+ *      sys_event_pio_ctrlr             PIO controller interrupt reason
+ *      sys_event_pio_changed           pio_cause (low word), pio_state (low
+ *                                      and high words)
+ *
+ ******************************************************************************/
+
+/*=============================================================================
+ *  SDK Header Files
+ *============================================================================*/
+#include <types.h>
+#include <mem.h>
+#include <timer.h>
+#include <gatt.h>
+#include <ls_app_if.h>
+#include <security.h>
+
+/*=============================================================================
+ *  Local Header Files
+ *============================================================================*/
+#include "event_trace.h"
+#include "perf_stats.h"
+#include "app_gatt.h"
+#include "remote_hw.h"
+
+#if defined(EVENT_TRACE_ENABLE)
+
+/*=============================================================================
+ *  Private Definitions
+ *============================================================================*/
+/* The number of records the trace buffer holds between flushes */
+#ifndef TRACE_BUFFER_RECORDS
+#define TRACE_BUFFER_RECORDS        (32)
+#endif /* TRACE_BUFFER_RECORDS */
+
+/* The buffer is flushed once it holds this many records */
+#define TRACE_FLUSH_RECORDS         (TRACE_BUFFER_RECORDS / 2)
+
+/* The delay before the flush, which lets the events already queued be
+ * handled (and recorded) first
+ */
+#define TRACE_FLUSH_DELAY           (1 * MILLISECOND)
+
+/*=============================================================================
+ *  Private Data
+ *============================================================================*/
+/* The trace ring buffer */
+static TRACE_RECORD_T traceBuffer[TRACE_BUFFER_RECORDS];
+/* The position of the oldest record, and the number of records held */
+static uint16 traceReadPosition;
+static uint16 traceCount;
+/* Records dropped because the buffer was full */
+static uint16 traceLost;
+/* The timer that flushes the buffer once it is half full */
+static timer_id traceFlushTid = TIMER_INVALID;
+
+/*=============================================================================
+ *  Private Function Prototypes
+ *============================================================================*/
+static void traceFlushTimerExpiry(timer_id tid);
+
+/*=============================================================================
+ *  Private Function Implementations
+ *============================================================================*/
+/*-----------------------------------------------------------------------------*
+ *  NAME
+ *      traceFlushTimerExpiry
+ *
+ *  DESCRIPTION
+ *      Flush the buffer, which has filled to TRACE_FLUSH_RECORDS.
+ *----------------------------------------------------------------------------*/
+static void traceFlushTimerExpiry(timer_id tid)
+{
+    traceFlushTid = TIMER_INVALID;
+
+    traceFlush();
+}
+
+/*-----------------------------------------------------------------------------*
+ *  NAME
+ *      newRecord
+ *
+ *  DESCRIPTION
+ *      Claim the next free record and fill in its header.
+ *
+ *  RETURNS
+ *      The record (payload zeroed), or NULL if the buffer is full.
+ *----------------------------------------------------------------------------*/
+static TRACE_RECORD_T *newRecord(TRACE_KIND kind, uint16 code)
+{
+    TRACE_RECORD_T *record;
+
+    if(traceCount >= TRACE_BUFFER_RECORDS)
+    {
+        traceLost++;
+        return NULL;
+    }
+
+    record = &traceBuffer[(traceReadPosition + traceCount) % TRACE_BUFFER_RECORDS];
+    traceCount++;
+
+    if((traceCount >= TRACE_FLUSH_RECORDS) && (traceFlushTid == TIMER_INVALID))
+    {
+        traceFlushTid = TimerCreate(TRACE_FLUSH_DELAY, TRUE,
+                                    traceFlushTimerExpiry);
+    }
+
+    record->time = PERF_TIME_NOW();
+    record->kind = kind;
+    record->code = code;
+    MemSet(record->payload, 0, sizeof(record->payload));
+
+    return record;
+}
+
+#if defined(DEBUG_ENABLE)
+/*-----------------------------------------------------------------------------*
+ *  NAME
+ *      writeRecord
+ *
+ *  DESCRIPTION
+ *      Write one record to the debug UART.
+ *----------------------------------------------------------------------------*/
+static void writeRecord(const TRACE_RECORD_T *record)
+{
+    uint16 word;
+
+    DebugWriteString("\r\nT ");
+    DebugWriteUint32(record->time);
+    DebugWriteString(" ");
+    DebugWriteUint16(record->kind);
+    DebugWriteString(" ");
+    DebugWriteUint16(record->code);
+
+    for(word = 0; word < TRACE_PAYLOAD_WORDS; word++)
+    {
+        DebugWriteString(" ");
+        DebugWriteUint16(record->payload[word]);
+    }
+}
+#endif /* DEBUG_ENABLE */
+
+/*=============================================================================
+ *  Public Function Implementations
+ *============================================================================*/
+
+/*-----------------------------------------------------------------------------*
+ *  NAME
+ *      traceInit
+ *
+ *  DESCRIPTION
+ *      Empty the trace buffer.
+ *----------------------------------------------------------------------------*/
+extern void traceInit(void)
+{
+    traceReadPosition = 0;
+    traceCount = 0;
+    traceLost = 0;
+    traceFlushTid = TIMER_INVALID;
+}
+
+/*-----------------------------------------------------------------------------*
+ *  NAME
+ *      traceLmEvent
+ *
+ *  DESCRIPTION
+ *      Record an event passed to AppProcessLmEvent(), together with the
+ *      payload fields listed at the top of this file.
+ *----------------------------------------------------------------------------*/
+extern void traceLmEvent(lm_event_code eventCode, LM_EVENT_T *eventData)
+{
+    TRACE_RECORD_T *record = newRecord(TRACE_KIND_LM, eventCode);
+
+    if(record == NULL)
+    {
+        return;
+    }
+
+    switch(eventCode)
+    {
+        case GATT_CONNECT_CFM:
+            record->payload[0] = ((GATT_CONNECT_CFM_T*)eventData)->result;
+            record->payload[1] = ((GATT_CONNECT_CFM_T*)eventData)->cid;
+            break;
+
+        case GATT_ACCESS_IND:
+            record->payload[0] = ((GATT_ACCESS_IND_T*)eventData)->handle;
+            record->payload[1] = ((GATT_ACCESS_IND_T*)eventData)->flags;
+            record->payload[2] = ((GATT_ACCESS_IND_T*)eventData)->size_value;
+            break;
+
+        case LM_EV_DISCONNECT_COMPLETE:
+            record->payload[0] = ((LM_EV_DISCONNECT_COMPLETE_T*)eventData)->data.reason;
+            break;
+
+        case LM_EV_ENCRYPTION_CHANGE:
+            record->payload[0] = eventData->enc_change.data.status;
+            record->payload[1] = eventData->enc_change.data.enc_enable;
+            break;
+
+        case LM_EV_CONNECTION_UPDATE:
+            record->payload[0] = ((LM_EV_CONNECTION_UPDATE_T*)eventData)->data.conn_interval;
+            record->payload[1] = ((LM_EV_CONNECTION_UPDATE_T*)eventData)->data.conn_latency;
+            record->payload[2] = ((LM_EV_CONNECTION_UPDATE_T*)eventData)->data.supervision_timeout;
+            break;
+
+        case LS_CONNECTION_PARAM_UPDATE_CFM:
+            record->payload[0] = ((LS_CONNECTION_PARAM_UPDATE_CFM_T*)eventData)->status;
+            break;
+
+        case LS_CONNECTION_PARAM_UPDATE_IND:
+            record->payload[0] = ((LS_CONNECTION_PARAM_UPDATE_IND_T*)eventData)->conn_interval;
+            record->payload[1] = ((LS_CONNECTION_PARAM_UPDATE_IND_T*)eventData)->conn_latency;
+            record->payload[2] = ((LS_CONNECTION_PARAM_UPDATE_IND_T*)eventData)->supervision_timeout;
+            break;
+
+        case SM_SIMPLE_PAIRING_COMPLETE_IND:
+            record->payload[0] = ((SM_SIMPLE_PAIRING_COMPLETE_IND_T*)eventData)->status;
+            break;
+
+        case SM_DIV_APPROVE_IND:
+            record->payload[0] = ((SM_DIV_APPROVE_IND_T*)eventData)->div;
+            break;
+
+        case GATT_CHAR_VAL_NOT_CFM:
+        case GATT_CHAR_VAL_IND_CFM:
+            record->payload[0] = ((GATT_CHAR_VAL_IND_CFM_T*)eventData)->result;
+            record->payload[1] = ((GATT_CHAR_VAL_IND_CFM_T*)eventData)->handle;
+            break;
+
+        default:
+            /* No payload recorded */
+            break;
+    }
+}
+
+/*-----------------------------------------------------------------------------*
+ *  NAME
+ *      traceSystemEvent
+ *
+ *  DESCRIPTION
+ *      Record an event passed to AppProcessSystemEvent().
+ *----------------------------------------------------------------------------*/
+extern void traceSystemEvent(sys_event_id id, void *data)
+{
+    TRACE_RECORD_T *record = newRecord(TRACE_KIND_SYSTEM, id);
+
+    if(record == NULL)
+    {
+        return;
+    }
+
+    switch(id)
+    {
+        case sys_event_pio_ctrlr:
+            record->payload[0] = PIO_INTERRUPT_REASON;
+            break;
+
+        case sys_event_pio_changed:
+            record->payload[0] = (uint16)(((pio_changed_data*)data)->pio_cause);
+            record->payload[1] = (uint16)(((pio_changed_data*)data)->pio_state);
+            record->payload[2] = (uint16)(((pio_changed_data*)data)->pio_state >> 16);
+            break;
+
+        default:
+            /* No payload recorded */
+            break;
+    }
+}
+
+/*-----------------------------------------------------------------------------*
+ *  NAME
+ *      traceStateChange
+ *
+ *  DESCRIPTION
+ *      Record an application state transition.
+ *----------------------------------------------------------------------------*/
+extern void traceStateChange(uint16 newState)
+{
+    (void)newRecord(TRACE_KIND_STATE, newState);
+}
+
+/*-----------------------------------------------------------------------------*
+ *  NAME
+ *      traceFlush
+ *
+ *  DESCRIPTION
+ *      Write the buffered records to the debug UART (DEBUG_ENABLE builds
+ *      only) and empty the buffer.
+ *----------------------------------------------------------------------------*/
+extern void traceFlush(void)
+{
+    TimerDelete(traceFlushTid);
+
+#if defined(DEBUG_ENABLE)
+    while(traceCount > 0)
+    {
+        writeRecord(&traceBuffer[traceReadPosition]);
+
+        traceReadPosition = (traceReadPosition + 1) % TRACE_BUFFER_RECORDS;
+        traceCount--;
+    }
+
+    if(traceLost > 0)
+    {
+        DebugWriteString("\r\nT lost ");
+        DebugWriteUint16(traceLost);
+    }
+#endif /* DEBUG_ENABLE */
+
+    traceInit();
+}
+
+#endif /* EVENT_TRACE_ENABLE */
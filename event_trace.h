@@ -0,0 +1,90 @@
+/*******************************************************************************
+ *    Copyright (C) Cambridge Silicon Radio Limited 2013
+ *
+ * FILE
+ *    event_trace.h
+ *
+ *  DESCRIPTION
+ *    Header file for the event trace. The trace records the firmware events
+ *    handled by the application, and the application state transitions, each
+ *    with a time-stamp, so that a field session can be captured and compared
+ *    between firmware revisions.
+ *
+ *    The trace is written to the debug UART, one record per line:
+ *
+ *        T <time> <kind> <code> <p0> <p1> <p2>
+ *
+ *    where all values are hexadecimal, <time> is in microseconds (as given
+ *    by PERF_TIME_NOW()), <kind> is a TRACE_KIND, <code> is the
+ *    lm_event_code, sys_event_id or new CURRENT_STATE_T, and <p0>..<p2> are
+ *    the payload words listed for each event in event_trace.c (unused words
+ *    are zero). The buffer is written out on the background tick, and as
+ *    soon as the application is idle once it is half full. If it fills up
+ *    before then, later records are dropped (the earlier ones are kept) and
+ *    a line "T lost <n>" after the records written reports how many.
+ *
+ ******************************************************************************/
+#ifndef _EVENT_TRACE_H
+#define _EVENT_TRACE_H
+
+/*=============================================================================
+ *  SDK Header Files
+ *============================================================================*/
+#include <types.h>
+#include <bt_event_types.h>
+#include <sys_events.h>
+
+/*=============================================================================
+ *  Local Header Files
+ *============================================================================*/
+#include "configuration.h"
+
+/*=============================================================================
+ *  Public Definitions
+ *============================================================================*/
+
+/* The number of payload words held with each trace record */
+#define TRACE_PAYLOAD_WORDS         (3)
+
+/* The kinds of trace record */
+typedef enum {
+    TRACE_KIND_LM,              /* An event passed to AppProcessLmEvent() */
+    TRACE_KIND_SYSTEM,          /* An event passed to AppProcessSystemEvent() */
+    TRACE_KIND_STATE            /* An application state transition */
+} TRACE_KIND;
+
+/* One trace record */
+typedef struct {
+    uint32 time;
+    uint16 kind;
+    uint16 code;
+    uint16 payload[TRACE_PAYLOAD_WORDS];
+} TRACE_RECORD_T;
+
+/*=============================================================================
+ *  Public function prototypes
+ *============================================================================*/
+#if defined(EVENT_TRACE_ENABLE)
+
+/* Empty the trace buffer */
+extern void traceInit(void);
+/* Record an event passed to AppProcessLmEvent() */
+extern void traceLmEvent(lm_event_code eventCode, LM_EVENT_T *eventData);
+/* Record an event passed to AppProcessSystemEvent() */
+extern void traceSystemEvent(sys_event_id id, void *data);
+/* Record an application state transition */
+extern void traceStateChange(uint16 newState);
+/* Write the buffered records to the debug UART and empty the buffer */
+extern void traceFlush(void);
+
+#else /* EVENT_TRACE_ENABLE */
+
+#define traceInit()
+#define traceLmEvent(_c_, _d_)
+#define traceSystemEvent(_i_, _d_)
+#define traceStateChange(_s_)
+#define traceFlush()
+
+#endif /* EVENT_TRACE_ENABLE */
+
+#endif /* _EVENT_TRACE_H */
@@ -27,28 +27,32 @@
  */
 #define CONNECTED_IDLE_TIMEOUT_VALUE          (3 * MINUTE)
 
-/* Advertising parameters, time is expressed in microseconds and the firmware
- * will round this down to the nearest slot. Acceptable range is 20ms to 10.24s
- * and the minimum must be no larger than the maximum. This value needs to be 
- * modified at later stage as decided GPA for specific profile.
+/* Advertising schedule. A bonded host is first sent high duty cycle directed
+ * advertisements, for the 1.28s the controller allows. Undirected
+ * advertisements then go through the stages below, each advertising at its
+ * interval for its duration; after the last stage the remote control gives
+ * up until the next user stimulus (movement or button press). User activity
+ * during any but the first stage restarts the schedule.
  *
- * To enable fast connections though the recommended range is between 20 ms to
- * 30 ms, but it has been observed that it is way too energy expensive. So, we
- * have decided to use 60 ms as the fast connection advertisement interval. For
- * reduced power connections, the recommended range is between 1s to 2.5 s.
- * Vendors will need to tune these values as per their requirements.
+ * Intervals are expressed in microseconds and the firmware will round them
+ * down to the nearest slot. Acceptable range is 20ms to 10.24s. The short
+ * first stages find a host that is scanning within a few advertising events;
+ * the last one keeps the total number of events (and so the charge used when
+ * no host is listening) below that of advertising at 60ms for 20s and then
+ * 384ms for 10s: about 339 events in 30s, against 359. How quickly hosts
+ * find the remote has not been measured on target; with PERF_STATS the key
+ * latency of the advertising categories and the "adv=" event count show the
+ * effect. Vendors will need to tune these values as per their requirements.
  */
-#define FC_ADVERTISING_INTERVAL_MIN           (60 * MILLISECOND)
-#define FC_ADVERTISING_INTERVAL_MAX           (60 * MILLISECOND)
-    
-#define RP_ADVERTISING_INTERVAL_MIN           (384 * MILLISECOND)
-#define RP_ADVERTISING_INTERVAL_MAX           (384 * MILLISECOND)
+#define ADV_SCHEDULE_STAGES                   (3)
 
-/* The remote control tries to reconnect for 20-seconds, after which it 
- * gives up until the next user stimulus (movement or button press).
- */
-#define FAST_CONNECTION_ADVERT_TIMEOUT_VALUE  (20 * SECOND)
-#define SLOW_CONNECTION_ADVERT_TIMEOUT_VALUE  (10 * SECOND)
+#define DECLARE_ADV_SCHEDULE()  \
+    static const ADV_STAGE_T advSchedule[ADV_SCHEDULE_STAGES] = {\
+        /* Interval,            Duration */                 \
+        {  20 * MILLISECOND,     1 * SECOND },              \
+        {  45 * MILLISECOND,     4 * SECOND },              \
+        { 125 * MILLISECOND,    25 * SECOND },              \
+    }
 
 /* Brackets should not be used around the values of macros that are used in .db
  * files. The parser which creates .c and .h files from .db file doesn't
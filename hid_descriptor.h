@@ -14,6 +14,35 @@
  *    using app version v150223.6448.
  *
  ******************************************************************************/
+#if defined(KEYBOARD_REPORT_PRESENT)
+#define HID_DESCRIPTOR_KEYBOARD	\
+             0x05, 0x01,        /* Usage page (Generic Desktop) */\
+             0x09, 0x06,        /* Usage (Keyboard) */\
+             0xa1, 0x01,        /* Collection (Application) */\
+             0x85, HID_KEYBOARD_REPORT_ID, /*   Report ID */\
+             0x05, 0x07,        /*   Usage page (Keyboard) */\
+             0x19, 0xe0,        /*   Usage Minimum (Left Control) */\
+             0x29, 0xe7,        /*   Usage Maximum (Right GUI) */\
+             0x15, 0x00,        /*   Logical Minimum (0) */\
+             0x25, 0x01,        /*   Logical Maximum (1) */\
+             0x95, 0x08,        /*   Report Count (8) */\
+             0x75, 0x01,        /*   Report Size (1) */\
+             0x81, 0x02,        /*   Input (Data,Var,Abs) - modifiers */\
+             0x95, 0x01,        /*   Report Count (1) */\
+             0x75, 0x08,        /*   Report Size (8) */\
+             0x81, 0x01,        /*   Input (Cnst) - reserved */\
+             0x19, 0x00,        /*   Usage Minimum (0) */\
+             0x29, 0x65,        /*   Usage Maximum (0x65) */\
+             0x15, 0x00,        /*   Logical Minimum (0) */\
+             0x25, 0x65,        /*   Logical Maximum (0x65) */\
+             0x95, 0x06,        /*   Report Count (6) */\
+             0x75, 0x08,        /*   Report Size (8) */\
+             0x81, 0x00,        /*   Input (Data,Ary,Abs) - keys */\
+             0xC0,
+#else
+#define HID_DESCRIPTOR_KEYBOARD
+#endif /* KEYBOARD_REPORT_PRESENT */
+
 #define DECLARE_HID_DESCRIPTOR()	\
 static uint8 hidDescriptor[] = \
 {\
@@ -28,5 +57,6 @@ static uint8 hidDescriptor[] = \
              0x95, 0x01,        /*   Report Count (1) */\
              0x75, 0x10,        /*   Report Size (16) */\
              0x81, 0x00,        /*   Input (Data,Ary,Abs) */\
-             0xC0\
+             0xC0,\
+             HID_DESCRIPTOR_KEYBOARD\
 }
@@ -18,6 +18,7 @@
  *============================================================================*/
 #include "configuration.h"
 #include "i2c_comms.h"
+#include "perf_stats.h"
 
 #if defined(PERIPHERAL_I2C_EXISTS)
 #if !defined(PERIPHERAL_SDA_PIO) || !defined(PERIPHERAL_SCL_PIO)
@@ -207,6 +208,7 @@ extern bool i2cReadRegister(uint8 baseAddress, uint8 reg, uint8 *registerValue)
                 (I2cRawStop(TRUE)               == sys_status_success));
     
     I2cRawTerminate();
+    perfCountI2cAccess();
     
     return success;
 }
@@ -244,6 +246,7 @@ extern bool i2cReadRegisters(uint8 baseAddress, uint8 startReg, uint8 numBytes,
               (I2cRawStop(TRUE)               == sys_status_success);
     
     I2cRawTerminate();
+    perfCountI2cAccess();
     
     return success;
 }
@@ -277,6 +280,7 @@ extern bool i2cWriteRegister(uint8 baseAddress, uint8 reg, uint8 registerValue)
                 (I2cRawStop(TRUE)               == sys_status_success));
     
     I2cRawTerminate();
+    perfCountI2cAccess();
     
     return success;
 }
@@ -309,6 +313,7 @@ extern bool i2cWriteRegisters(uint8 baseAddress, uint8 startReg, uint8 numBytes,
                 (I2cRawStop(TRUE)               == sys_status_success));
 
     I2cRawTerminate();
+    perfCountI2cAccess();
 
     return success;
 }
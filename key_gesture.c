@@ -0,0 +1,263 @@
+/*******************************************************************************
+ *    Copyright (C) Cambridge Silicon Radio Limited 2015
+ *
+ * FILE
+ *    key_gesture.c
+ *
+ *  DESCRIPTION
+ *    The key gesture engine. It follows the key press and release events
+ *    produced by the key-scan module and matches them against a table of
+ *    gestures:
+ *
+ *      GESTURE_LONG_PRESS  the handler is called once the key has been held
+ *                          down for 'time'.
+ *      GESTURE_REPEAT      as a long press, then again every 'interval' for
+ *                          as long as the key is held down.
+ *      GESTURE_DOUBLE_TAP  the handler is called when the key is pressed
+ *                          within 'time' of being released.
+ *      GESTURE_CHORD       the handler is called when 'key' and 'otherKey'
+ *                          are pressed (in either order) within 'time' of
+ *                          each other.
+ *
+ *    Only the most recently pressed key can be timing a long press or a
+ *    repeat: pressing another key cancels it. This needs one timer, however
+ *    many gestures the table holds. Double-taps and chords are timed from the
+ *    event times and need no timer at all.
+ *
+ ******************************************************************************/
+
+/*=============================================================================
+ *  SDK Header Files
+ *============================================================================*/
+#include <types.h>
+#include <time.h>
+#include <timer.h>
+
+/*=============================================================================
+ *  Local Header Files
+ *============================================================================*/
+#include "key_gesture.h"
+
+/*=============================================================================
+ *  Private Data
+ *============================================================================*/
+/* The gesture table in use */
+static const GESTURE_T *gestures;
+
+/* The timer used for long presses and repeats, and the gesture it is timing */
+static timer_id gestureTid = TIMER_INVALID;
+static const GESTURE_T *armedGesture;
+
+/* The most recent key press, and whether that key is still held down */
+static uint16 lastPressKey;
+static uint32 lastPressTime;
+static bool lastPressHeld;
+
+/* The most recent key release, for double-taps */
+static uint16 lastReleaseKey;
+static uint32 lastReleaseTime;
+/* The most recent key press completed a double-tap */
+static bool tapDone;
+
+/*=============================================================================
+ *  Private Function Prototypes
+ *============================================================================*/
+static void disarm(void);
+static void gestureTimerExpired(timer_id tid);
+
+/*=============================================================================
+ *  Private Function Implementations
+ *============================================================================*/
+/*-----------------------------------------------------------------------------*
+ *  NAME
+ *      disarm
+ *
+ *  DESCRIPTION
+ *      Stop timing a long press or repeat (if one is being timed).
+ *----------------------------------------------------------------------------*/
+static void disarm(void)
+{
+    if(gestureTid != TIMER_INVALID)
+    {
+        TimerDelete(gestureTid);
+        gestureTid = TIMER_INVALID;
+    }
+
+    armedGesture = NULL;
+}
+
+/*-----------------------------------------------------------------------------*
+ *  NAME
+ *      gestureTimerExpired
+ *
+ *  DESCRIPTION
+ *      The key being timed has been held down long enough: act on the
+ *      gesture, and keep the timer going if it repeats.
+ *----------------------------------------------------------------------------*/
+static void gestureTimerExpired(timer_id tid)
+{
+    const GESTURE_T *gesture = armedGesture;
+
+    gestureTid = TIMER_INVALID;
+
+    if(gesture == NULL)
+    {
+        return;
+    }
+
+    if(gesture->type == GESTURE_REPEAT)
+    {
+        gestureTid = TimerCreate(gesture->interval, TRUE, gestureTimerExpired);
+    }
+    else
+    {
+        armedGesture = NULL;
+    }
+
+    gesture->handler(gesture->key);
+}
+
+/*=============================================================================
+ *  Public Function Implementations
+ *============================================================================*/
+/*-----------------------------------------------------------------------------*
+ *  NAME
+ *      gestureInit
+ *
+ *  DESCRIPTION
+ *      Start recognising the gestures in the given table, which ends with
+ *      GESTURE_TABLE_END. Any gesture being timed is abandoned, and no keys
+ *      are taken to be held down.
+ *----------------------------------------------------------------------------*/
+extern void gestureInit(const GESTURE_T *table)
+{
+    disarm();
+
+    gestures = table;
+    lastPressKey = 0;
+    lastPressHeld = FALSE;
+    lastReleaseKey = 0;
+    tapDone = FALSE;
+}
+
+/*-----------------------------------------------------------------------------*
+ *  NAME
+ *      gestureKeyEvent
+ *
+ *  DESCRIPTION
+ *      Pass a key press or release to the gesture engine. The handlers of any
+ *      double-tap or chord completed by a press are called before this
+ *      function returns; long presses and repeats are acted on later, from
+ *      the gesture timer.
+ *
+ *  PARAMETERS
+ *      key         The HID code assigned to the key (0 if disabled)
+ *      pressed     TRUE if the key was pressed, FALSE if released
+ *
+ *  RETURNS
+ *      TRUE if the key is used only for gestures and must not be reported.
+ *----------------------------------------------------------------------------*/
+extern bool gestureKeyEvent(uint16 key, bool pressed)
+{
+    const GESTURE_T *gesture;
+    const GESTURE_T *hold = NULL;   /* the long press or repeat to time */
+    bool consumed = FALSE;
+    uint32 now = TimeGet32();
+
+    if(pressed)
+    {
+        tapDone = FALSE;
+    }
+
+    for(gesture = gestures; gesture->type != GESTURE_END; gesture++)
+    {
+        if(gesture->key == key)
+        {
+            consumed |= gesture->consume;
+        }
+
+        if(!pressed)
+        {
+            continue;
+        }
+
+        switch(gesture->type)
+        {
+            case GESTURE_LONG_PRESS:
+            case GESTURE_REPEAT:
+                /* One shared timer: the first hold entry for the key wins */
+                if((gesture->key == key) && (hold == NULL))
+                {
+                    hold = gesture;
+                }
+                break;
+
+            case GESTURE_DOUBLE_TAP:
+                if((gesture->key == key) && (lastReleaseKey == key) &&
+                   ((now - lastReleaseTime) <= gesture->time))
+                {
+                    tapDone = TRUE;
+                    gesture->handler(key);
+                }
+                break;
+
+            case GESTURE_CHORD:
+                if(lastPressHeld &&
+                   (((gesture->key == key) && (gesture->otherKey == lastPressKey)) ||
+                    ((gesture->key == lastPressKey) && (gesture->otherKey == key))) &&
+                   ((now - lastPressTime) <= gesture->time))
+                {
+                    gesture->handler(gesture->key);
+                }
+                break;
+
+            default:
+                break;
+        }
+    }
+
+    if(pressed)
+    {
+        /* A new key press ends the timing of any other key */
+        disarm();
+
+        if(hold != NULL)
+        {
+            armedGesture = hold;
+            gestureTid = TimerCreate(hold->time, TRUE, gestureTimerExpired);
+        }
+
+        lastPressKey = key;
+        lastPressTime = now;
+        lastPressHeld = TRUE;
+        lastReleaseKey = 0;
+    }
+    else
+    {
+        if((armedGesture != NULL) && (armedGesture->key == key))
+        {
+            /* Released before (or while) the gesture timer acted */
+            disarm();
+        }
+
+        if(key == lastPressKey)
+        {
+            lastPressHeld = FALSE;
+        }
+
+        /* The release that ends a double-tap does not start another, so a
+         * third tap is taken as the first of a new pair.
+         */
+        if(tapDone && (key == lastPressKey))
+        {
+            tapDone = FALSE;
+        }
+        else
+        {
+            lastReleaseKey = key;
+            lastReleaseTime = now;
+        }
+    }
+
+    return consumed;
+}
@@ -0,0 +1,69 @@
+/*******************************************************************************
+ *    Copyright (C) Cambridge Silicon Radio Limited 2015
+ *
+ * FILE
+ *    key_gesture.h
+ *
+ *  DESCRIPTION
+ *    Header file for the key gesture engine. Gestures (long-press, double-tap,
+ *    two-key chords and hold-to-repeat) are described by a table keyed by the
+ *    HID code of the key, and recognised from the key press and release
+ *    events using a single shared timer.
+ *
+ ******************************************************************************/
+#ifndef _KEY_GESTURE_H
+#define _KEY_GESTURE_H
+
+/*=============================================================================
+ *  SDK Header Files
+ *============================================================================*/
+#include <types.h>
+
+/*=============================================================================
+ *  Public Definitions
+ *============================================================================*/
+
+/* The supported gesture types. A key has at most one hold gesture: only the
+ * first GESTURE_LONG_PRESS or GESTURE_REPEAT entry for it in a table is timed,
+ * and any later ones for the same key are ignored.
+ */
+typedef enum {
+    GESTURE_END,            /* Marks the end of a gesture table */
+    GESTURE_LONG_PRESS,     /* Key held down for 'time' */
+    GESTURE_DOUBLE_TAP,     /* Key pressed again within 'time' of its release */
+    GESTURE_CHORD,          /* Key and 'otherKey' pressed within 'time' of each other */
+    GESTURE_REPEAT          /* Key held down for 'time', then every 'interval' */
+} GESTURE_TYPE;
+
+/* The action taken when a gesture is recognised; passed the gesture's key */
+typedef void (*GESTURE_HANDLER)(uint16 key);
+
+/* One entry of a gesture table */
+typedef struct {
+    GESTURE_TYPE type;
+    /* The HID code of the key that makes the gesture */
+    uint16 key;
+    /* GESTURE_CHORD only: the HID code of the other key of the chord */
+    uint16 otherKey;
+    /* Hold time, tap gap or chord window (us) */
+    uint32 time;
+    /* GESTURE_REPEAT only: the repeat period (us) */
+    uint32 interval;
+    /* Presses of 'key' are used only for this gesture, not reported */
+    bool consume;
+    GESTURE_HANDLER handler;
+} GESTURE_T;
+
+/* The entry that ends every gesture table */
+#define GESTURE_TABLE_END   {GESTURE_END, 0, 0, 0, 0, FALSE, NULL}
+
+/*=============================================================================
+ *  Public function prototypes
+ *============================================================================*/
+
+/* Start recognising the gestures in the given table (no keys held down) */
+extern void gestureInit(const GESTURE_T *table);
+/* Pass a key press or release to the engine; TRUE if the key is consumed */
+extern bool gestureKeyEvent(uint16 key, bool pressed);
+
+#endif /* _KEY_GESTURE_H */
@@ -28,6 +28,7 @@
  *============================================================================*/
 
 #include "key_scan.h"
+#include "key_gesture.h"
 
 #include "service_hid.h"
 #include "app_gatt_db.h"
@@ -36,53 +37,294 @@
 #include "state.h"
 #include "advertise.h"
 #include "event_handler.h"
+#include "remote_hw.h"
 #if defined(IR_PROTOCOL_IRDB) || defined(IR_PROTOCOL_NEC) || defined(IR_PROTOCOL_RC5)
 #include "nvm_access.h"
 #endif /* IR_PROTOCOL_IRDB || IR_PROTOCOL_NEC || IR_PROTOCOL_RC5 */
 
 
 /*=============================================================================*
- *  Private Data
+ *  Private Definitions
  *============================================================================*/
 
-DECLARE_KEY_MATRIX();
-
-/* State variables for comparing previous and current key-scan results */
-static uint16 lastKeyCount;
-static BUTTON_TYPE lastPressedButtonType = BUTTON_UNKNOWN;
-static uint16 holdButton = 0x0000;
+/* The maximum number of reportable keys tracked as held down at once */
+#define MAX_PRESSED_KEYS        (8)
+
+#if !defined(KEYSCAN_DENSE_KEY_MATRIX)
+/* An entry of the sparse key look-up table (see keyRows) */
+#define KEY_ROW_ENTRY(_base_, _mask_)   (((_base_) << 8) | (_mask_))
+#define KEY_ROW_BASE(_entry_)           ((_entry_) >> 8)
+#define KEY_ROW_MASK(_entry_)           ((_entry_) & 0xff)
+#endif /* !KEYSCAN_DENSE_KEY_MATRIX */
+
+#if defined(KEYBOARD_REPORT_PRESENT)
+/* The number of keys (other than modifiers) a keyboard report can hold */
+#define KEYBOARD_ROLLOVER_KEYS  (6)
+/* The modifier keys: Left Control (0xe0) to Right GUI (0xe7) */
+#define KEYBOARD_FIRST_MODIFIER (0xe0)
+#define KEYBOARD_LAST_MODIFIER  (0xe7)
+/* Reported in every key position when the keys held down cannot be reported */
+#define KEYBOARD_ERROR_ROLLOVER (0x01)
+#endif /* KEYBOARD_REPORT_PRESENT */
 
 #if defined(CLEAR_PAIRING_KEY)
-static timer_id clear_pairing_tid = TIMER_INVALID;
-
+/* A dedicated clear-pairing key is used only to clear the pairing */
+#if defined(CLEAR_PAIRING_DUAL_PURPOSE)
+#define CLEAR_PAIRING_CONSUMED  (FALSE)
+#else
+#define CLEAR_PAIRING_CONSUMED  (TRUE)
+#endif /* CLEAR_PAIRING_DUAL_PURPOSE */
 #endif /* CLEAR_PAIRING_KEY */
 
+#if defined(KEY_AUTO_REPEAT)
+/* A gesture table entry that repeats a key at the rate of its class */
+#define KEY_REPEAT(_key_, _class_)  \
+    {GESTURE_REPEAT, (_key_), 0, KEY_REPEAT_##_class_##_DELAY, \
+     KEY_REPEAT_##_class_##_PERIOD, FALSE, onKeyRepeat}
+#endif /* KEY_AUTO_REPEAT */
+
+/*=============================================================================*
+ *  Private Data
+ *============================================================================*/
+
+DECLARE_KEY_MATRIX();
+
+#if !defined(KEYSCAN_DENSE_KEY_MATRIX)
+/* The sparse key look-up table, built from RemoteKeyMatrix by
+ * buildKeyTables(): one entry per row, with the index of the row's first key
+ * code in RemoteKeyMatrix (MSB) and a mask of the columns that hold a key
+ * (LSB). RemoteKeyMatrix itself is compacted to hold only the key codes, row
+ * by row in column order.
+ */
+static uint16 keyRows[SCAN_MATRIX_ROWS_BYTE_COUNT];
+#endif /* !KEYSCAN_DENSE_KEY_MATRIX */
+
+/* Number of bits set in each 4-bit value */
+static const uint8 nibbleBitCount[16] = {
+    0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4
+};
+
+/* Position of the lowest set bit in each (non-zero) 4-bit value */
+static const uint8 nibbleLowestBit[16] = {
+    0, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0
+};
+
+/* The previous key-scan snapshot, against which changes are detected */
+static uint8 lastScanReport[SCAN_MATRIX_ROWS_BYTE_COUNT];
+
+/* The number of keys currently held down (all keys in the matrix) */
+static uint16 keyCount;
+
+/* The reportable (Consumer page) keys currently held down, oldest first */
+static uint16 pressedKeys[MAX_PRESSED_KEYS];
+static uint16 numPressedKeys;
+
+/* Set while the key-scan snapshot is ambiguous because of ghosting */
+static bool ghosted;
+
+#if defined(KEYBOARD_REPORT_PRESENT)
+/* The Keyboard page keys (other than modifiers) held down, oldest first */
+static uint16 keyboardKeys[MAX_PRESSED_KEYS];
+static uint16 numKeyboardKeys;
+/* The modifier keys held down, one bit each (bit 0 is Left Control) */
+static uint16 keyboardModifiers;
+/* Set when the keyboard report has changed */
+static bool keyboardChanged;
+#endif /* KEYBOARD_REPORT_PRESENT */
+
 /*=============================================================================*
  *  Private Function Prototypes
  *============================================================================*/
  
+#if !defined(KEYSCAN_DENSE_KEY_MATRIX)
+static void buildKeyTables(void);
+#endif /* !KEYSCAN_DENSE_KEY_MATRIX */
+static uint16 lookupKey(uint16 row, uint16 column);
+static bool isGhosted(uint8* scan_report);
+static void removeHeldKey(uint16* keys, uint16* num_keys, uint16 this_key);
 static void onFunctionButton(uint8 fnNum);
+#if defined(KEYBOARD_REPORT_PRESENT)
+static void onKeyboardKey(uint16 usage, bool pressed);
+#endif /* KEYBOARD_REPORT_PRESENT */
+static void onKeyEvent(uint16 this_key, bool pressed);
 #if defined(CLEAR_PAIRING_KEY)
-static void clear_pairing_timer(timer_id tid);
+static void onClearPairing(uint16 key);
 #endif /* CLEAR_PAIRING_KEY */
+#if defined(KEY_AUTO_REPEAT)
+static void onKeyRepeat(uint16 key);
+#endif /* KEY_AUTO_REPEAT */
+
+/* The key gestures, ending with GESTURE_TABLE_END. Add shortcuts here (the
+ * handlers are declared above).
+ */
+static const GESTURE_T gestureTable[] = {
+#if defined(CLEAR_PAIRING_KEY)
+    /* Press and hold to clear the pairing information */
+    {GESTURE_LONG_PRESS, CLEAR_PAIRING_KEY, 0, CLEAR_PAIRING_TIMER, 0,
+     CLEAR_PAIRING_CONSUMED, onClearPairing},
+#endif /* CLEAR_PAIRING_KEY */
+#if defined(KEY_AUTO_REPEAT)
+    /* Held keys that the remote repeats */
+    KEY_REPEAT(0x00e9, VOLUME),         /* Volume Up */
+    KEY_REPEAT(0x00ea, VOLUME),         /* Volume Down */
+    KEY_REPEAT(0x0042, NAVIGATION),     /* Menu Up */
+    KEY_REPEAT(0x0043, NAVIGATION),     /* Menu Down */
+    KEY_REPEAT(0x0044, NAVIGATION),     /* Menu Left */
+    KEY_REPEAT(0x0045, NAVIGATION),     /* Menu Right */
+#endif /* KEY_AUTO_REPEAT */
+    GESTURE_TABLE_END
+};
 
 
 /*=============================================================================*
  *  Private Function Implementations
  *============================================================================*/
 
+#if !defined(KEYSCAN_DENSE_KEY_MATRIX)
+/*-----------------------------------------------------------------------------*
+ *  NAME
+ *      buildKeyTables
+ *
+ *  DESCRIPTION
+ *      Builds the sparse key look-up table from the (generated) key matrix,
+ *      compacting the matrix in place. Each key code moves down to an index
+ *      no higher than its own, so none is overwritten before it is read. Must
+ *      be called once only.
+ *----------------------------------------------------------------------------*/
+static void buildKeyTables(void)
+{
+    uint16 row;
+    uint16 column;
+    uint16 code;
+    uint16 mask;
+    uint16 base;
+    uint16 count = 0;
+
+    for(row = 0; row < SCAN_MATRIX_ROWS_BYTE_COUNT; row++)
+    {
+        base = count;
+        mask = 0;
+
+        for(column = 0; column < 8; column++)
+        {
+            /* Row r, column c is at (1 + 8r + c) in the key matrix */
+            code = RemoteKeyMatrix[1 + (row << 3) + column];
+            if(code != 0)
+            {
+                mask |= (1 << column);
+                RemoteKeyMatrix[count++] = code;
+            }
+        }
+
+        keyRows[row] = KEY_ROW_ENTRY(base, mask);
+    }
+}
+#endif /* !KEYSCAN_DENSE_KEY_MATRIX */
+
+/*-----------------------------------------------------------------------------*
+ *  NAME
+ *      lookupKey
+ *
+ *  DESCRIPTION
+ *      Returns the key code at the given row and column of the key matrix, or
+ *      0 if there is no key there. In the sparse tables, the key is found by
+ *      counting the keys fitted to the left of it in the same row.
+ *----------------------------------------------------------------------------*/
+static uint16 lookupKey(uint16 row, uint16 column)
+{
+#if defined(KEYSCAN_DENSE_KEY_MATRIX)
+    /* Row r, column c is at (1 + 8r + c) in the key matrix */
+    return RemoteKeyMatrix[1 + (row << 3) + column];
+#else
+    const uint16 mask = KEY_ROW_MASK(keyRows[row]);
+    const uint16 before = mask & ((1 << column) - 1);
+
+    if((mask & (1 << column)) == 0)
+    {
+        /* No key is fitted here */
+        return 0;
+    }
+
+    return RemoteKeyMatrix[KEY_ROW_BASE(keyRows[row]) +
+                           nibbleBitCount[before & 0x0f] +
+                           nibbleBitCount[before >> 4]];
+#endif /* KEYSCAN_DENSE_KEY_MATRIX */
+}
+
+/*-----------------------------------------------------------------------------*
+ *  NAME
+ *      isGhosted
+ *
+ *  DESCRIPTION
+ *      Checks a key-scan snapshot for ghosting. Without a diode per key, three
+ *      keys held down at three corners of a rectangle in the matrix make the
+ *      fourth corner read as pressed too. A snapshot in which two rows share
+ *      more than one pressed column may therefore hold a key that is not
+ *      really pressed.
+ *
+ *  RETURNS
+ *      TRUE if the snapshot may contain a ghost key.
+ *----------------------------------------------------------------------------*/
+static bool isGhosted(uint8* scan_report)
+{
+    uint16 i, j;
+    uint16 shared;          /* columns pressed in both rows */
+
+    for(i = 0; i < SCAN_MATRIX_ROWS_BYTE_COUNT; i++)
+    {
+        for(j = i + 1; j < SCAN_MATRIX_ROWS_BYTE_COUNT; j++)
+        {
+            shared = scan_report[i] & scan_report[j] & 0xff;
+
+            if(shared & (shared - 1))
+            {
+                /* More than one column in common */
+                return TRUE;
+            }
+        }
+    }
+
+    return FALSE;
+}
+
+/*-----------------------------------------------------------------------------*
+ *  NAME
+ *      removeHeldKey
+ *
+ *  DESCRIPTION
+ *      Removes a released key from a list of held keys, keeping the order in
+ *      which the remaining keys were pressed.
+ *----------------------------------------------------------------------------*/
+static void removeHeldKey(uint16* keys, uint16* num_keys, uint16 this_key)
+{
+    uint16 i;
+
+    for(i = 0; i < *num_keys; i++)
+    {
+        if(keys[i] == this_key)
+        {
+            /* Close the gap one key at a time; the ranges overlap */
+            for((*num_keys)--; i < *num_keys; i++)
+            {
+                keys[i] = keys[i + 1];
+            }
+            break;
+        }
+    }
+}
+
 #if defined(CLEAR_PAIRING_KEY)
  
 /*-----------------------------------------------------------------------------*
  *  NAME
- *      clear_pairing_timer
+ *      onClearPairing
  *
  *  DESCRIPTION
- *      This function handles the clear pairing timer. It is called when the
- *      timer expires, indicating that the clear pairing button has been held
- *      down for long enough to trigger clearing of the pairing information.
+ *      This gesture handler is called when the clear pairing button has been
+ *      held down for long enough to trigger clearing of the pairing
+ *      information.
  *----------------------------------------------------------------------------*/
-static void clear_pairing_timer(timer_id tid)
+static void onClearPairing(uint16 key)
 {
     /* The user wants to re-pair this remote. */
     
@@ -104,11 +346,47 @@ static void clear_pairing_timer(timer_id tid)
         default:
             break;
     }
-    
-    clear_pairing_tid = TIMER_INVALID;
 }
 #endif /* CLEAR_PAIRING_KEY */
 
+#if defined(KEY_AUTO_REPEAT)
+/*-----------------------------------------------------------------------------*
+ *  NAME
+ *      onKeyRepeat
+ *
+ *  DESCRIPTION
+ *      This gesture handler is called periodically while a repeating key is
+ *      held down. The key's report is sent again if the key is still the one
+ *      being reported.
+ *----------------------------------------------------------------------------*/
+static void onKeyRepeat(uint16 key)
+{
+    if(ghosted)
+    {
+        /* The keys held down are not known */
+        return;
+    }
+
+#if defined(KEYBOARD_REPORT_PRESENT)
+    if(key & IS_KEYBOARD_KEY)
+    {
+        if((numKeyboardKeys > 0) && 
+           (numKeyboardKeys <= KEYBOARD_ROLLOVER_KEYS) &&
+           (keyboardKeys[numKeyboardKeys - 1] == (key & 0xff)))
+        {
+            hwSendKeyRepeat(HID_KEYBOARD_REPORT_ID);
+        }
+        return;
+    }
+#endif /* KEYBOARD_REPORT_PRESENT */
+
+    if((numPressedKeys > 0) && (pressedKeys[numPressedKeys - 1] == key))
+    {
+        hwSendKeyRepeat(HID_CONSUMER_REPORT_ID);
+    }
+}
+#endif /* KEY_AUTO_REPEAT */
+
 /*-----------------------------------------------------------------------------*
  *  NAME
  *      onFunctionButton
@@ -158,6 +436,136 @@ static void onFunctionButton(uint8 fnNum)
 #endif /* IR_PROTOCOL_IRDB || IR_PROTOCOL_NEC || IR_PROTOCOL_RC5 */
 }
 
+#if defined(KEYBOARD_REPORT_PRESENT)
+/*-----------------------------------------------------------------------------*
+ *  NAME
+ *      onKeyboardKey
+ *
+ *  DESCRIPTION
+ *      This function handles a Keyboard Page key being pressed or released.
+ *      Modifier keys are held as a bit each; other keys are added to or
+ *      removed from the list of held keyboard keys.
+ *
+ *  PARAMETERS
+ *      usage       The Keyboard Page usage ID of the key
+ *      pressed     TRUE if the key was pressed, FALSE if released
+ *
+ *  RETURNS
+ *      Nothing.
+ *----------------------------------------------------------------------------*/
+static void onKeyboardKey(uint16 usage, bool pressed)
+{
+    if((usage >= KEYBOARD_FIRST_MODIFIER) && (usage <= KEYBOARD_LAST_MODIFIER))
+    {
+        if(pressed)
+        {
+            keyboardModifiers |= (1 << (usage - KEYBOARD_FIRST_MODIFIER));
+        }
+        else
+        {
+            keyboardModifiers &= ~(1 << (usage - KEYBOARD_FIRST_MODIFIER));
+        }
+    }
+    else if(pressed)
+    {
+        if(numKeyboardKeys < MAX_PRESSED_KEYS)
+        {
+            keyboardKeys[numKeyboardKeys++] = usage;
+        }
+    }
+    else
+    {
+        removeHeldKey(keyboardKeys, &numKeyboardKeys, usage);
+    }
+
+    keyboardChanged = TRUE;
+}
+#endif /* KEYBOARD_REPORT_PRESENT */
+
+/*-----------------------------------------------------------------------------*
+ *  NAME
+ *      onKeyEvent
+ *
+ *  DESCRIPTION
+ *      This function handles a single key being pressed or released. Every
+ *      change is passed to the gesture engine (long-presses such as clear
+ *      pairing, double-taps, chords, repeats) first. Function buttons are
+ *      acted upon here; reportable keys are added to or removed from the list
+ *      of held keys.
+ *
+ *  PARAMETERS
+ *      this_key    The HID code assigned to the key (0 if disabled)
+ *      pressed     TRUE if the key was pressed, FALSE if released
+ *
+ *  RETURNS
+ *      Nothing.
+ *----------------------------------------------------------------------------*/
+static void onKeyEvent(uint16 this_key, bool pressed)
+{
+    if(gestureKeyEvent(this_key, pressed))
+    {
+        /* The key is used only for gestures */
+        return;
+    }
+
+    switch(this_key)
+    {
+        case 0x0000:
+            /* HID reports are disabled for this button */
+            break;
+
+        /* If this remote defines function buttons, insert the necessary
+         * handlers here. By default they set the active controlled device if
+         * using IR. Function buttons act on the press only.
+         */
+        case FUNCTION_BUTTON_1:
+        case FUNCTION_BUTTON_2:
+        case FUNCTION_BUTTON_3:
+        case FUNCTION_BUTTON_4:
+        case FUNCTION_BUTTON_5:
+        case FUNCTION_BUTTON_6:
+        case FUNCTION_BUTTON_7:
+        case FUNCTION_BUTTON_8:
+            if(pressed)
+            {
+                onFunctionButton((uint8)((this_key - FUNCTION_BUTTON_1 + 1) & 0xFF));
+            }
+            break;
+
+        default:
+#if defined(IR_PROTOCOL_IRDB) || defined(IR_PROTOCOL_NEC) || defined(IR_PROTOCOL_RC5)
+            /* Only perform HID report sending if the selected device is the Host */
+            if(pressed && (localData.controlledDevice != IRCONTROL_HOST))
+            {
+                break;
+            }
+#endif /* IR_PROTOCOL_IRDB || IR_PROTOCOL_NEC || IR_PROTOCOL_RC5 */
+
+#if defined(KEYBOARD_REPORT_PRESENT)
+            if(this_key & IS_KEYBOARD_KEY)
+            {
+                /* Button on the Keyboard Page */
+                onKeyboardKey(this_key & 0xff, pressed);
+                break;
+            }
+#endif /* KEYBOARD_REPORT_PRESENT */
+
+            /* Button on the Consumer Page */
+            if(pressed)
+            {
+                if(numPressedKeys < MAX_PRESSED_KEYS)
+                {
+                    pressedKeys[numPressedKeys++] = this_key;
+                }
+            }
+            else
+            {
+                removeHeldKey(pressedKeys, &numPressedKeys, this_key);
+            }
+            break;
+    }
+}
+
 
 
 /*=============================================================================*
@@ -175,6 +583,21 @@ static void onFunctionButton(uint8 fnNum)
  *----------------------------------------------------------------------------*/
 void keyscanInit(void)
 {
+    /* No keys are held down yet */
+    MemSet(lastScanReport, 0, sizeof(lastScanReport));
+    keyCount = 0;
+    numPressedKeys = 0;
+    ghosted = FALSE;
+    gestureInit(gestureTable);
+#if !defined(KEYSCAN_DENSE_KEY_MATRIX)
+    buildKeyTables();
+#endif /* !KEYSCAN_DENSE_KEY_MATRIX */
+#if defined(KEYBOARD_REPORT_PRESENT)
+    numKeyboardKeys = 0;
+    keyboardModifiers = 0;
+    keyboardChanged = FALSE;
+#endif /* KEYBOARD_REPORT_PRESENT */
+
     /* Give the PIO controller access to the PIOs */
     PioSetModes(PIO_CONTROLLER_BIT_MASK, pio_mode_pio_controller);
 
@@ -202,15 +625,16 @@ void keyscanInit(void)
  *      Processes the scan_report from the PIO controller in order to determine
  *      which buttons are currently pressed down, fills in a hid_report
  *      accordingly, and then reports back to the calling function by means of a
- *      BUTTON_SCAN_T object. The actual buttons pressed are communicated with
- *      HID codes in the HID report. Thus only one Consumer page button can be
- *      reported at a time, as Consumer HID reports only contain one button. The
- *      number of buttons pressed down is however passed out in buttonStatus,
- *      and since key-scan occurs rather quickly, we should be able to pick them
- *      out one at a time as the number increments. Keyboard Page HID reports
- *      support multiple buttons per report. If IR is enabled, then IR "presses"
- *      and "releases" are dealt with in this function too (only one code can be
- *      sent at a time).
+ *      BUTTON_SCAN_T object.
+ *
+ *      The report is compared with the previous one, and only the keys whose
+ *      state has changed are looked up in the key matrix; each is passed to
+ *      onKeyEvent() as a press or a release. The work done therefore depends
+ *      on the number of keys that changed, not on the size of the matrix.
+ *
+ *      Consumer HID reports only contain one button, so the HID report holds
+ *      the most recently pressed Consumer key that is still held down. The
+ *      number of such keys held down is passed out in buttonStatus.
  *
  *  PARAMETERS
  *      *scan_report    [Input]
@@ -235,218 +659,128 @@ void keyscanInit(void)
  *----------------------------------------------------------------------------*/
 extern void keyscanProcessScanReport(uint8* scan_report, uint8* hid_report, BUTTON_SCAN_T* buttonStatus)
 {
-    uint8 i, j;             /* loop counters */
-    uint8 arrayIndex = 1;   /* current "look up" location in key matrix */
-    uint16 reportWord;      /* temporary storage for an entire key-scan row */
-    uint16 this_key = 0;
-    bool done = FALSE;      /* skip main scan loop (or what remains) */
-    uint16 keyCount = 0;
-    
+    uint16 i;               /* row counter */
+    uint16 changed;         /* keys in this row that have changed state */
+    uint16 pressed;         /* keys in this row that have been pressed */
+    uint16 released;        /* keys in this row that have been released */
+    uint16 column;          /* column of the changed key being handled */
+    uint16 this_key;
+    bool nowGhosted = isGhosted(scan_report);
+
+#if defined(KEYBOARD_REPORT_PRESENT)
+    if(nowGhosted != ghosted)
+    {
+        /* The keyboard report shows ghosting as a rollover error */
+        keyboardChanged = TRUE;
+    }
+#endif /* KEYBOARD_REPORT_PRESENT */
 
-    /* Set data defaults, as required */
-    buttonStatus->pressedButtonType = BUTTON_UNKNOWN;
-    buttonStatus->numPressedConsumerKeys = 0;
-    
-    /* First do a quick pass to check how many keys are held down in total. If
-     * it's 0 then the last key has been released and we don't need to do a full
-     * scan/decode.
+    /* A snapshot with ghosting cannot be decoded reliably, so hold on to the
+     * last good state until the ghosting clears.
      */
-    for(i = 0; i < SCAN_MATRIX_ROWS_BYTE_COUNT; i++)
+    ghosted = nowGhosted;
+
+    for(i = 0; (i < SCAN_MATRIX_ROWS_BYTE_COUNT) && !ghosted; i++)
     {
-        for(j = 1; j & 0xFF; j <<= 1)
+        changed = (scan_report[i] ^ lastScanReport[i]) & 0xff;
+
+        if(changed == 0)
         {
-            if(scan_report[i] & j) keyCount++;
+            /* Nothing has changed in this row */
+            continue;
         }
-    }
-    
-    if (keyCount < lastKeyCount)
-    {
-        /* Key release event */  
-        holdButton = 0x0000;
-        if (keyCount == 0)
+
+        /* Keep the count of held keys up to date */
+        pressed = changed & scan_report[i];
+        released = changed & lastScanReport[i];
+        keyCount += nibbleBitCount[pressed & 0x0f] + nibbleBitCount[pressed >> 4];
+        keyCount -= nibbleBitCount[released & 0x0f] + nibbleBitCount[released >> 4];
+
+        lastScanReport[i] = scan_report[i];
+
+        /* Visit each changed key, lowest column first */
+        while(changed != 0)
         {
-            /* All keys released, don't do a full scan/decode */
-            done = TRUE;
-            /* Reset state variable */
-            lastPressedButtonType = BUTTON_UNKNOWN;
-#if defined(IR_PROTOCOL_IRDB) || defined(IR_PROTOCOL_NEC) || defined(IR_PROTOCOL_RC5)
-            /* Stop sending IR */
-#endif /* IR_PROTOCOL_IRDB || IR_PROTOCOL_NEC || IR_PROTOCOL_RC5 */
+            if(changed & 0x0f)
+            {
+                column = nibbleLowestBit[changed & 0x0f];
+            }
+            else
+            {
+                column = 4 + nibbleLowestBit[changed >> 4];
+            }
+
+            changed &= ~(1 << column);
+
+            this_key = lookupKey(i, column);
+
+            onKeyEvent(this_key, (pressed & (1 << column)) != 0);
         }
     }
 
-    /* Look for report bytes (rows) containing set bits (pressed keys) */
-    i = 0;
-    while((i < SCAN_MATRIX_ROWS_BYTE_COUNT) && !done)
+    /* Report the most recently pressed Consumer key still held down */
+    buttonStatus->numPressedConsumerKeys = numPressedKeys;
+    buttonStatus->numPressedKeys = keyCount;
+#if defined(KEYBOARD_REPORT_PRESENT)
+    buttonStatus->numPressedKeyboardKeys = numKeyboardKeys;
+    buttonStatus->keyboardReportChanged = keyboardChanged;
+    keyboardChanged = FALSE;
+#endif /* KEYBOARD_REPORT_PRESENT */
+
+    if(numPressedKeys > 0)
     {
-        /* Grab the next row */
-        reportWord = scan_report[i];
+        this_key = pressedKeys[numPressedKeys - 1];
 
-        if(reportWord > 0)
-        {
-            /* This byte (row) contains a pressed key */
-            
-            /* For each bit (key) of the byte (row)... */
-            for(j = 0; j < 8; j++)
-            {
-                if(reportWord & 0x1)
-                {
-                    /* If reportWord lowest bit is set then we have found
-                     * a pressed key, it is shifted right after each iteration
-                     * to scan along the row, with arrayIndex identifying the
-                     * particular key (also incremented on each iteration).
-                     */
-                    this_key = RemoteKeyMatrix[arrayIndex];
+        buttonStatus->pressedButtonType = BUTTON_CONSUMER;
+        hid_report[0] = WORD_LSB(this_key);
+        hid_report[1] = WORD_MSB(this_key);
+    }
+    else
+    {
+        buttonStatus->pressedButtonType = BUTTON_UNKNOWN;
+    }
+}
 
-#if defined(CLEAR_PAIRING_KEY)
-                    /* Catch clear pairing key */
-                    if(this_key == CLEAR_PAIRING_KEY)
-                    {
-                        if(clear_pairing_tid == TIMER_INVALID)
-                        {
-                            clear_pairing_tid = TimerCreate(CLEAR_PAIRING_TIMER, TRUE, clear_pairing_timer);
-                        }
-                    }
-#ifndef CLEAR_PAIRING_DUAL_PURPOSE
-                    else
-#endif /* !CLEAR_PAIRING_DUAL_PURPOSE */
-#endif /* CLEAR_PAIRING_KEY */
-                    {
-                        /* Catch special keys first, handle later */
-                        switch(this_key)
-                        {
-                            /* If this remote defines function buttons, insert
-                             * the necessary handlers here. By default they set
-                             * the active controlled device if using IR.
-                             */
-                            case FUNCTION_BUTTON_1:
-                            case FUNCTION_BUTTON_2:
-                            case FUNCTION_BUTTON_3:
-                            case FUNCTION_BUTTON_4:
-                            case FUNCTION_BUTTON_5:
-                            case FUNCTION_BUTTON_6:
-                            case FUNCTION_BUTTON_7:
-                            case FUNCTION_BUTTON_8:
-                                onFunctionButton((uint8)((this_key - FUNCTION_BUTTON_1 + 1) & 0xFF));
-                                break;
-                            
-                            default:
-                                /* Now perform "normal" keyscan operations, as applicable */
-#if defined(IR_PROTOCOL_IRDB) || defined(IR_PROTOCOL_NEC) || defined(IR_PROTOCOL_RC5)
-                                if (   keyCount == 1 
-                                    && keyCount >= lastKeyCount 
-                                   )
-                                {
-                                    /* If there is exactly 1 key pressed, 
-                                        and there were no keys pressed before,
-                                        and this pressed key has an IR assignment
-                                        and there is an IR command definition for this IR assignment on the currently selected device*/
-                                }
-                                else
-                                {
-                                    /* Only perform HID report sending if selected device is the Host
-                                     * and HID reports are not disabled for this button.
-                                     */
-                                    if(localData.controlledDevice == IRCONTROL_HOST && this_key != 0)
-#else
-                                    /* Only perform HID report sending if HID reports are not disabled 
-                                     * for this button.
-                                     */
-                                    if(this_key != 0)
-#endif /* IR_PROTOCOL_IRDB || IR_PROTOCOL_NEC || IR_PROTOCOL_RC5 */
-                                    {
-                                        {
-                                            /* Button on the Consumer Page */
-                                            buttonStatus->numPressedConsumerKeys++;
-                                            
-                                            if (holdButton == this_key)
-                                            {
-                                                /* We have already reported this key in a previous instance
-                                                 * of the loop, we are looking for new buttons so do not
-                                                 * fill in the HID report.
-                                                 */
-                                                buttonStatus->pressedButtonType = BUTTON_CONSUMER;
-                                                
-                                            }
-                                            else
-                                            {
-                                                if (lastPressedButtonType == BUTTON_UNKNOWN)
-                                                {
-                                                    /* No other keys of interest detected yet on this loop
-                                                     * instance (this is the first, there may be more).
-                                                     * 
-                                                     * If we already had a button held down, then this is
-                                                     * the new button and just happens to be earlier in the
-                                                     * key matrix than the held button. If not, then we are
-                                                     * starting from scratch and we need to record that we
-                                                     * have already seen this button for future loop
-                                                     * instances. In any case the button press needs to be
-                                                     * reported so fill in the HID report.
-                                                     */
-                                                    if (holdButton == 0x0000)
-                                                    {
-                                                        holdButton = this_key;
-                                                    }
-                                                    buttonStatus->pressedButtonType = BUTTON_CONSUMER;
-                                                    hid_report[0] = WORD_LSB(this_key);
-                                                    hid_report[1] = WORD_MSB(this_key);
-                                                }
-                                                else if (lastPressedButtonType == BUTTON_CONSUMER)
-                                                {
-                                                    /* This is the second key of this type detected on this
-                                                     * loop instance. Only one Consumer key can be reported
-                                                     * at a time, so report this one as it is newer (only 1
-                                                     * consumer key press is really supported, but we need
-                                                     * to know what state we are in so we leave it up to a
-                                                     * higher level calling function to decide what to do).
-                                                     */
-                                                    buttonStatus->pressedButtonType = BUTTON_CONSUMER;
-                                                    hid_report[0] = WORD_LSB(this_key);
-                                                    hid_report[1] = WORD_MSB(this_key);
-                                                }
-                                            }
-                                        }
-                                        lastPressedButtonType = buttonStatus->pressedButtonType;
-                                    }
-#if defined(IR_PROTOCOL_IRDB) || defined(IR_PROTOCOL_NEC) || defined(IR_PROTOCOL_RC5)
-                                }
-#endif /* IR_PROTOCOL_IRDB || IR_PROTOCOL_NEC || IR_PROTOCOL_RC5 */
-                            break;
-                            
-                        }   /* End switch(this_key)*/
-                    }
-                }   /* End if(reportWord & 0x1) */
-                
-                /* We want to detect multiple key-presses, so continue. */
-                reportWord >>= 1;
-                arrayIndex++;
-                
-            }   /* End loop over keys in row */
+#if defined(KEYBOARD_REPORT_PRESENT)
+/*-----------------------------------------------------------------------------*
+ *  NAME
+ *      keyscanGetKeyboardReport
+ *
+ *  DESCRIPTION
+ *      Fills in the keyboard report (HID_KEYBOARD_DATA_LENGTH bytes) for the
+ *      Keyboard Page buttons held down: the modifier bits, a reserved byte and
+ *      up to KEYBOARD_ROLLOVER_KEYS keys, oldest first. If more keys are held
+ *      down, or the matrix is ghosting, every key position reports
+ *      ErrorRollOver so that the host keeps its current state.
+ *
+ *  PARAMETERS
+ *      *keyboard_report    [Output]
+ *                          Pointer to the keyboard report to be filled in.
+ *
+ *  RETURNS
+ *      Nothing.
+ *----------------------------------------------------------------------------*/
+extern void keyscanGetKeyboardReport(uint8* keyboard_report)
+{
+    uint16 i;
+
+    MemSet(keyboard_report, 0, HID_KEYBOARD_DATA_LENGTH);
+
+    keyboard_report[0] = keyboardModifiers;
+
+    for(i = 0; i < KEYBOARD_ROLLOVER_KEYS; i++)
+    {
+        if(ghosted || (numKeyboardKeys > KEYBOARD_ROLLOVER_KEYS))
+        {
+            keyboard_report[2 + i] = KEYBOARD_ERROR_ROLLOVER;
         }
-        else    /* reportWord = 0 */
+        else if(i < numKeyboardKeys)
         {
-            /* Jump 8 positions along the lookup table (next row down) */
-            arrayIndex += 8;
+            keyboard_report[2 + i] = keyboardKeys[i];
         }
-        /* We want to detect multiple key-presses, so continue. */
-        i++;
-    }   /* End loop over rows */
-    
-    
-
-    
-#if defined(CLEAR_PAIRING_KEY)
-    if((this_key != CLEAR_PAIRING_KEY) &&
-       (clear_pairing_tid != TIMER_INVALID))
-    {
-        /* Assume the pairing key has just been released */
-        
-        TimerDelete(clear_pairing_tid);
-        clear_pairing_tid = TIMER_INVALID;
     }
-#endif /* CLEAR_PAIRING_USING_KEYS */
-    lastKeyCount = keyCount;
 }
+#endif /* KEYBOARD_REPORT_PRESENT */
 
 
 /*============================================================================
@@ -33,11 +33,23 @@ typedef struct
     BUTTON_TYPE pressedButtonType;
     /* Number of Consumer Page buttons pressed */
     uint8 numPressedConsumerKeys;
+    /* Number of keys held down in the matrix (of any type) */
+    uint8 numPressedKeys;
+#if defined(KEYBOARD_REPORT_PRESENT)
+    /* Number of Keyboard Page buttons (other than modifiers) pressed */
+    uint8 numPressedKeyboardKeys;
+    /* The keyboard report has changed (see keyscanGetKeyboardReport()) */
+    bool keyboardReportChanged;
+#endif /* KEYBOARD_REPORT_PRESENT */
 } BUTTON_SCAN_T;
 
 /* Identify function buttons */
 #define IS_FUNCTION_BUTTON              (0x8000)
 
+/* Identify Keyboard Page buttons; the usage ID is in the LSB */
+#define IS_KEYBOARD_KEY                 (0x4000)
+#define KEYBOARD_KEY(_usage_)           (IS_KEYBOARD_KEY | (_usage_))
+
 
 
 /* Function button identifiers */
@@ -106,5 +118,9 @@ typedef struct
 extern void keyscanInit(void);
 /* Process the report from the PIO controller: */
 extern void keyscanProcessScanReport(uint8* scan_report, uint8* hid_report, BUTTON_SCAN_T* button_info);
+#if defined(KEYBOARD_REPORT_PRESENT)
+/* Fill in the keyboard report for the Keyboard Page buttons held down: */
+extern void keyscanGetKeyboardReport(uint8* keyboard_report);
+#endif /* KEYBOARD_REPORT_PRESENT */
 
 #endif /* _KEYSCAN_H */
@@ -3,10 +3,40 @@
  
  Notifications and indications are held in a buffer, prior to being sent to 
  the remote device. This buffering is required as the lower layers can handle 
- only one notification/indication at a time, whereas the host may send through 
- messages that contain multiple notifications/indications.
+ only a few notifications/indications at a time, whereas the host may send 
+ through messages that contain multiple notifications/indications.
  
- The buffering is implemented as a static array, using a ring-buffer mechanism.
+ The buffering is implemented as static arrays, using a ring-buffer mechanism.
+ There is one ring buffer (lane) per priority: input reports go in the high
+ lane, background traffic (battery level, OTA data) in the low lane. The high
+ lane is sent first, but the low lane is not starved: it is sent at least once
+ in every LOW_LANE_MAX_WAIT + 1 notifications while it has one waiting.
+
+ Each lane is an array of words holding variable-length records: a header
+ (NOTIFICATION_RECORD) followed by the notification data, one octet per uint8
+ as GattCharValueNotification() takes it. A record is never split across the
+ end of the array; if it does not fit before the end, a record with the handle
+ WRAP_HANDLE is left in its place (if there is room for one) and the record is
+ written at the start. A 2-octet input report therefore takes a few words
+ rather than a slot sized for the longest notification.
+
+ Up to NOTIFICATION_WINDOW notifications are handed to the firmware before the
+ first of them is confirmed. Confirmations arrive in the order the
+ notifications were sent; a notification is only removed from its lane once
+ it has been confirmed. If the firmware rejects one, it is sent again together
+ with every notification sent after it from the same lane, so that each lane
+ stays in order.
+
+ With NOTIFICATION_BATCHING, notifications buffered while others are in
+ flight are not sent as each confirmation arrives. Radio events are turned on
+ instead, and the notifications waiting are sent together from a timer that
+ expires just before the next connection event (see handleCreateReportTimer()).
+ Radio events are turned off again once nothing is waiting.
+
+ Every notification is time-stamped when it is buffered. A handle may have a
+ maximum age: a notification older than that which is still waiting to be sent
+ is dropped if two later notifications for the same handle (a newer press and
+ release) supersede it.
 ******************************************************************************/
 
 /*============================================================================
@@ -15,6 +45,7 @@
 #include <gatt.h>
 #include <mem.h>
 #include <timer.h>
+#include <ls_app_if.h>
 
 /*============================================================================
  * Local Header Files
@@ -23,89 +54,616 @@
 #include "notifications.h"
 #include "remote.h"
 #include "configuration.h"
+#include "perf_stats.h"
 
 /*============================================================================
  * Private Definitions
  *============================================================================*/
-/* The number of notifications that can be buffered. */
-#define MAX_BUFFERED_NOTIFICATIONS      20
+/* The number of words of notification records that can be buffered in each
+ * lane. The high lane holds 12 (PERF_STATS builds) to 18 consumer reports;
+ * the low lane holds 2 OTA data transfers.
+ */
+#define HIGH_LANE_WORDS                 128
+#define LOW_LANE_WORDS                  64
 /* The maximum length of a notification. */
 #define MAX_NOTIFICATION_DATA_LEN_BYTES 20
 
-/* A macro to determine the number of items in the buffer, taking the ring-buffer
- * structure into account.
+/* The number of high-lane notifications that may be sent in a row while a
+ * low-lane notification is waiting.
  */
-#define NUM_BUFFERED_ITEMS(_r_, _w_)    ((_r_ <= _w_) ? (_w_ - _r_) : ((MAX_BUFFERED_NOTIFICATIONS - _r_) + _w_))
+#define LOW_LANE_MAX_WAIT               4
 
-/* A macro to increment a count to the next position, taking the ring-buffer
- * structure into account.
+/* The handle of the record that marks the end of the records before the
+ * start of a lane's array (no attribute has handle 0).
  */
-#define SET_NEXT_POSITION(_v_) {    \
-    if (_v_ < (MAX_BUFFERED_NOTIFICATIONS - 1)) _v_ = _v_ + 1;  \
-    else _v_ = 0;   \
-    }
-    
-/* A macro to decrement a count to the previous position, taking the ring-buffer
- * structure into account.
- */
-#define SET_PREV_POSITION(_v_) {    \
-    if (_v_ > 0) _v_ = _v_ - 1;  \
-    else _v_ = (MAX_BUFFERED_NOTIFICATIONS - 1);   \
-    }
+#define WRAP_HANDLE                     0
+
+/* The number of words taken by a record with the given data length */
+#define RECORD_WORDS(_len_)             \
+    ((sizeof(NOTIFICATION_RECORD) + ((_len_) * sizeof(uint8)) + sizeof(uint16) - 1) / sizeof(uint16))
+
+/* The record at a position in a lane, and its data */
+#define RECORD(_l_, _p_)                ((NOTIFICATION_RECORD *)&(_l_)->buffer[_p_])
+#define RECORD_DATA(_r_)                ((uint8 *)((_r_) + 1))
 
-/* The possible internal states of this module. */
+/* findUnsentItem() found no item */
+#define NO_ITEM                         0xffff
+
+/* How a new value is combined with an unsent value for the same handle */
 typedef enum {
-    ALL_QUIET,                  /* No notification/indication response is outstanding */
-    NOTIFICATION_OUTSTANDING    /* A notification has been sent and the response is outstanding */
-} NOTIFICATION_STATE;
+    COALESCE_NEVER,             /* Every value is sent (events, e.g. key press/release) */
+    COALESCE_LATEST             /* Only the latest value is sent (state, e.g. battery level) */
+} COALESCE_POLICY;
 
-/* This is the structure that defines each element of the notification buffer array. */
+/* The coalescing policy, lane and maximum age of a handle */
 typedef struct {
     uint16 handle;
+    COALESCE_POLICY policy;
+    NOTIFICATION_LANE lane;
+    uint32 maxAge;              /* Age (us) after which a superseded notification is dropped; 0 for never */
+} NOTIFICATION_POLICY_T;
+
+#if defined(PERF_STATS_ENABLE)
+/* Count a notification event in the statistics */
+#define COUNT_NOTIFICATION(_c_)         (notificationStats._c_++)
+#else
+#define COUNT_NOTIFICATION(_c_)
+#endif /* PERF_STATS_ENABLE */
+
+/* The header of each record in a lane. The notification data follows it. */
+typedef struct {
+    uint16 handle;              /* WRAP_HANDLE for the record marking a wrap */
     uint16 dataLenInBytes;
-    uint8  notification[MAX_NOTIFICATION_DATA_LEN_BYTES];
-} NOTIFICATION_ITEM;
+    bool   isRepeat;            /* A repeat, which a later repeat may replace */
+    uint32 bufferedTime;        /* When the notification was buffered */
+#if defined(PERF_STATS_ENABLE)
+    PERF_KEY_STAMP_T keyStamp;  /* The key change (if any) that caused this item */
+#endif /* PERF_STATS_ENABLE */
+} NOTIFICATION_RECORD;
+
+/* A priority lane: a ring buffer of records. Positions are word offsets of
+ * records in the buffer.
+ */
+typedef struct {
+    uint16 *buffer;
+    uint16 size;                /* The number of words in the buffer */
+    /* This is the position that the next notification (to be buffered) should be written to. */
+    uint16 writePosition;
+    /* This is the position of the oldest notification that has not been confirmed. */
+    uint16 readPosition;
+    /* This is the position that the next notification (to be sent) should be read from. */
+    uint16 sendPosition;
+    /* This is the position of the notification the lane's next confirmation is for. */
+    uint16 cfmPosition;
+    /* The number of the lane's notifications whose confirmation is outstanding. */
+    uint16 inFlight;
+} NOTIFICATION_LANE_T;
 
 /*============================================================================
  * Private Data
  *============================================================================*/
-/* Declare the notification buffer. */
-static NOTIFICATION_ITEM notificationBuffer[MAX_BUFFERED_NOTIFICATIONS];
-
-/* This is the position that the next notification (to be buffered) should be written to. */
-static uint16 notificationWritePosition = 0;
-/* This is the position that the next notification (to be sent) should be read from. */
-static uint16 notificationReadPosition = 0;
-/* This is the current state of this module. */
-static NOTIFICATION_STATE currentState = ALL_QUIET;
-/* Indicates that all data should be dropped the next time the transmission result is received. */
-static bool dropOnNextRegistration = FALSE;
+/* The handles that are coalesced, sent in the low lane or expire; any other
+ * handle is COALESCE_NEVER, sent in the high lane and never expires. Input
+ * reports are key press/release edges, which must all be sent while they are
+ * fresh (repeats of a held key are coalesced separately, see
+ * notificationRepeatItem()).
+ */
+static const NOTIFICATION_POLICY_T notificationPolicies[] = {
+    {HANDLE_BATT_LEVEL,             COALESCE_LATEST,    NOTIFICATION_LANE_LOW,  0},
+    {HANDLE_CSR_OTA_DATA_TRANSFER,  COALESCE_NEVER,     NOTIFICATION_LANE_LOW,  0},
+    {HANDLE_HID_CONSUMER_REPORT,    COALESCE_NEVER,     NOTIFICATION_LANE_HIGH, KEY_REPORT_MAX_AGE},
+#if defined(KEYBOARD_REPORT_PRESENT)
+    {HANDLE_HID_KEYBOARD_REPORT,    COALESCE_NEVER,     NOTIFICATION_LANE_HIGH, KEY_REPORT_MAX_AGE},
+#endif /* KEYBOARD_REPORT_PRESENT */
+};
+
+/* Declare the notification buffers. */
+static uint16 highLaneBuffer[HIGH_LANE_WORDS];
+static uint16 lowLaneBuffer[LOW_LANE_WORDS];
+
+/* The lanes, in priority order */
+static NOTIFICATION_LANE_T notificationLanes[NOTIFICATION_LANES] = {
+    {highLaneBuffer,    HIGH_LANE_WORDS,    0, 0, 0, 0, 0},
+    {lowLaneBuffer,     LOW_LANE_WORDS,     0, 0, 0, 0, 0}
+};
+
+/* The lane of each notification in flight, oldest first (a ring buffer) */
+static uint16 inFlightLanes[NOTIFICATION_WINDOW];
+static uint16 inFlightOldest = 0;
+/* The number of notifications sent whose confirmation is outstanding. */
+static uint16 notificationsInFlight = 0;
+/* High-lane notifications sent in a row while the low lane had one waiting */
+static uint16 lowLaneWait = 0;
+
+#if defined(NOTIFICATION_BATCHING)
+/* Notifications are waiting for the slot before the next connection event */
+static bool batchPending = FALSE;
+#endif /* NOTIFICATION_BATCHING */
+
+#if defined(PERF_STATS_ENABLE)
+/* Notification sending statistics */
+static NOTIFICATION_STATS_T notificationStats;
+#endif /* PERF_STATS_ENABLE */
 
 /*============================================================================
  * Private Function Implementations
  *============================================================================*/
+/*----------------------------------------------------------------------------
+ *  NAME
+ *      findPolicy
+ *
+ *  DESCRIPTION
+ *      Returns the coalescing policy, lane and maximum age of a handle.
+ *---------------------------------------------------------------------------*/
+static const NOTIFICATION_POLICY_T *findPolicy(uint16 handle)
+{
+    static const NOTIFICATION_POLICY_T defaultPolicy =
+        {0, COALESCE_NEVER, NOTIFICATION_LANE_HIGH, 0};
+    uint16 i;
+
+    for(i = 0; i < (sizeof(notificationPolicies) / sizeof(notificationPolicies[0])); i++)
+    {
+        if(notificationPolicies[i].handle == handle)
+        {
+            return &notificationPolicies[i];
+        }
+    }
+
+    return &defaultPolicy;
+}
+
+/*----------------------------------------------------------------------------
+ *  NAME
+ *      wrapPosition
+ *
+ *  DESCRIPTION
+ *      Returns the position at which the record at the given position
+ *      starts: the start of the array if there is no room for a record
+ *      before the end, or if a wrap record is there.
+ *---------------------------------------------------------------------------*/
+static uint16 wrapPosition(NOTIFICATION_LANE_T *lane, uint16 position)
+{
+    if(((lane->size - position) < RECORD_WORDS(0)) ||
+       ((position != lane->writePosition) &&
+        (RECORD(lane, position)->handle == WRAP_HANDLE)))
+    {
+        return 0;
+    }
+
+    return position;
+}
+
+/*----------------------------------------------------------------------------
+ *  NAME
+ *      nextRecord
+ *
+ *  DESCRIPTION
+ *      Returns the position of the record after the one at the given
+ *      position.
+ *---------------------------------------------------------------------------*/
+static uint16 nextRecord(NOTIFICATION_LANE_T *lane, uint16 position)
+{
+    return wrapPosition(lane, position + RECORD_WORDS(RECORD(lane, position)->dataLenInBytes));
+}
+
+/*----------------------------------------------------------------------------
+ *  NAME
+ *      wrapPositions
+ *
+ *  DESCRIPTION
+ *      Moves the read, send and confirmation positions of a lane past a wrap
+ *      record just written where they pointed.
+ *---------------------------------------------------------------------------*/
+static void wrapPositions(NOTIFICATION_LANE_T *lane)
+{
+    lane->readPosition = wrapPosition(lane, lane->readPosition);
+    lane->sendPosition = wrapPosition(lane, lane->sendPosition);
+    lane->cfmPosition = wrapPosition(lane, lane->cfmPosition);
+}
+
+/*----------------------------------------------------------------------------
+ *  NAME
+ *      placeRecord
+ *
+ *  DESCRIPTION
+ *      Returns where a record of the given size, to be written at the given
+ *      position, must go: there, or at the start of the array (leaving a
+ *      wrap record, if there is room for one) if it does not fit before the
+ *      end.
+ *---------------------------------------------------------------------------*/
+static uint16 placeRecord(NOTIFICATION_LANE_T *lane, uint16 position, uint16 words)
+{
+    if((lane->size - position) >= words)
+    {
+        return position;
+    }
+
+    if((lane->size - position) >= RECORD_WORDS(0))
+    {
+        RECORD(lane, position)->handle = WRAP_HANDLE;
+    }
+
+    return 0;
+}
+
+/*----------------------------------------------------------------------------
+ *  NAME
+ *      recordFits
+ *
+ *  DESCRIPTION
+ *      Returns TRUE if a record of the given size can be written at the
+ *      lane's write position (or, wrapping, at the start of the array)
+ *      without reaching the oldest record still held.
+ *---------------------------------------------------------------------------*/
+static bool recordFits(NOTIFICATION_LANE_T *lane, uint16 words)
+{
+    uint16 write = lane->writePosition;
+    uint16 read = lane->readPosition;
+    uint16 end;
+
+    if(write < read)
+    {
+        return ((write + words) < read);
+    }
+
+    if((lane->size - write) >= words)
+    {
+        end = write + words;
+        if((lane->size - end) < RECORD_WORDS(0))
+        {
+            end = 0;
+        }
+        if(end != read)
+        {
+            return TRUE;
+        }
+    }
+
+    /* Wrap to the start of the array */
+    return (words < read);
+}
+
+/*----------------------------------------------------------------------------
+ *  NAME
+ *      isSuperseded
+ *
+ *  DESCRIPTION
+ *      Returns TRUE if at least two later notifications for the same handle
+ *      as the one at the given position are buffered in the lane. The last
+ *      two reports of a handle (normally the last key press and its release)
+ *      are then never superseded.
+ *---------------------------------------------------------------------------*/
+static bool isSuperseded(NOTIFICATION_LANE_T *lane, uint16 position)
+{
+    uint16 handle = RECORD(lane, position)->handle;
+    uint16 later = 0;
+
+    position = nextRecord(lane, position);
+    while(position != lane->writePosition)
+    {
+        if((RECORD(lane, position)->handle == handle) && (++later == 2))
+        {
+            return TRUE;
+        }
+        position = nextRecord(lane, position);
+    }
+
+    return FALSE;
+}
+
+/*----------------------------------------------------------------------------
+ *  NAME
+ *      expireNotifications
+ *
+ *  DESCRIPTION
+ *      Drops the notifications waiting to be sent from a lane that are older
+ *      than their handle's maximum age and have been superseded, closing up
+ *      the gaps. Keys pressed and released during a reconnection are then
+ *      not replayed to the host once they are stale, but the newest press and
+ *      release (e.g. of the key that woke the remote) are always sent.
+ *
+ *      Notifications are buffered in time order, so nothing has expired
+ *      unless the next notification to be sent has.
+ *---------------------------------------------------------------------------*/
+static void expireNotifications(NOTIFICATION_LANE_T *lane)
+{
+    uint32 now = TimeGet32();
+    const NOTIFICATION_POLICY_T *policy;
+    NOTIFICATION_RECORD *record;
+    uint16 from;
+    uint16 next;
+    uint16 to;
+    uint16 words;
+    uint16 i;
+
+    /* The notifications sent and awaiting confirmation must stay in place */
+    if((lane->sendPosition == lane->writePosition) ||
+       (lane->cfmPosition != lane->readPosition))
+    {
+        return;
+    }
+
+    record = RECORD(lane, lane->sendPosition);
+    policy = findPolicy(record->handle);
+    if((policy->maxAge == 0) ||
+       ((now - record->bufferedTime) <= policy->maxAge))
+    {
+        return;
+    }
+
+    from = lane->sendPosition;
+    to = lane->sendPosition;
+    while(from != lane->writePosition)
+    {
+        record = RECORD(lane, from);
+        policy = findPolicy(record->handle);
+        next = nextRecord(lane, from);
+
+        if((policy->maxAge != 0) &&
+           ((now - record->bufferedTime) > policy->maxAge) &&
+           isSuperseded(lane, from))
+        {
+            /* Drop it */
+            COUNT_NOTIFICATION(expired);
+        }
+        else
+        {
+            /* Move it down to close the gap. Records only move towards
+             * the start of the array (or wrap there), so copying upwards
+             * never overwrites words still to be copied.
+             */
+            words = RECORD_WORDS(record->dataLenInBytes);
+            to = placeRecord(lane, to, words);
+            if(to != from)
+            {
+                for(i = 0; i < words; i++)
+                {
+                    lane->buffer[to + i] = lane->buffer[from + i];
+                }
+            }
+            to = to + words;
+            if((lane->size - to) < RECORD_WORDS(0))
+            {
+                to = 0;
+            }
+        }
+        from = next;
+    }
+    lane->writePosition = to;
+    wrapPositions(lane);
+}
+
+/*----------------------------------------------------------------------------
+ *  NAME
+ *      laneReady
+ *
+ *  DESCRIPTION
+ *      Returns TRUE if the lane has a notification waiting to be sent. A
+ *      lane sends nothing while the confirmations of its notifications that
+ *      are to be sent again are still outstanding.
+ *---------------------------------------------------------------------------*/
+static bool laneReady(NOTIFICATION_LANE_T *lane)
+{
+    return (lane->cfmPosition == lane->readPosition) &&
+           (lane->sendPosition != lane->writePosition);
+}
+
+/*----------------------------------------------------------------------------
+ *  NAME
+ *      selectLane
+ *
+ *  DESCRIPTION
+ *      Chooses the lane to send the next notification from: the high lane,
+ *      unless the low lane has waited for LOW_LANE_MAX_WAIT notifications.
+ *
+ *  RETURNS
+ *      The lane, or NOTIFICATION_LANES if there is nothing to send.
+ *---------------------------------------------------------------------------*/
+static uint16 selectLane(void)
+{
+    bool highReady = laneReady(&notificationLanes[NOTIFICATION_LANE_HIGH]);
+    bool lowReady = laneReady(&notificationLanes[NOTIFICATION_LANE_LOW]);
+
+    if(lowReady && (!highReady || (lowLaneWait >= LOW_LANE_MAX_WAIT)))
+    {
+        lowLaneWait = 0;
+        return NOTIFICATION_LANE_LOW;
+    }
+
+    if(highReady)
+    {
+        if(lowReady)
+        {
+            lowLaneWait++;
+        }
+        return NOTIFICATION_LANE_HIGH;
+    }
+
+    return NOTIFICATION_LANES;
+}
+
 /*----------------------------------------------------------------------------
  *  NAME
  *      sendNextNotification
  *
  *  DESCRIPTION
- *      If there are notifications waiting to be sent, then
- *      this function sends the next notification to the remote device.
+ *      If there are notifications waiting to be sent, then this function
+ *      sends them to the remote device, highest priority first, until
+ *      NOTIFICATION_WINDOW are awaiting confirmation.
  *---------------------------------------------------------------------------*/
 static void sendNextNotification(void)
 {
-    /* If there are notifications in the buffer waiting to be sent... */
-    if((currentState == ALL_QUIET) &&
-       (NUM_BUFFERED_ITEMS(notificationReadPosition, notificationWritePosition) > 0))
+    uint16 laneIndex;
+    NOTIFICATION_LANE_T *lane;
+    NOTIFICATION_RECORD *record;
+    uint16 slot;
+
+    for(laneIndex = 0; laneIndex < NOTIFICATION_LANES; laneIndex++)
     {
+        expireNotifications(&notificationLanes[laneIndex]);
+    }
+
+    /* While there are notifications in the buffers waiting to be sent... */
+    while((notificationsInFlight < NOTIFICATION_WINDOW) &&
+          ((laneIndex = selectLane()) != NOTIFICATION_LANES))
+    {
+        lane = &notificationLanes[laneIndex];
+        record = RECORD(lane, lane->sendPosition);
+
         /* ... try to send the next message in the buffer: */
         GattCharValueNotification(localData.st_ucid, 
-                                  notificationBuffer[notificationReadPosition].handle, 
-                                  notificationBuffer[notificationReadPosition].dataLenInBytes,
-                                  notificationBuffer[notificationReadPosition].notification);
+                                  record->handle, 
+                                  record->dataLenInBytes,
+                                  RECORD_DATA(record));
+
+        /* Record the key-to-air latency, if this item was caused by a key change */
+        perfKeyStampSent(&record->keyStamp);
         
-        currentState = NOTIFICATION_OUTSTANDING;
+        lane->sendPosition = nextRecord(lane, lane->sendPosition);
+        lane->inFlight++;
+
+        /* Note the lane, to match the confirmation to it */
+        slot = inFlightOldest + notificationsInFlight;
+        if(slot >= NOTIFICATION_WINDOW)
+        {
+            slot -= NOTIFICATION_WINDOW;
+        }
+        inFlightLanes[slot] = laneIndex;
+        notificationsInFlight++;
+
+        COUNT_NOTIFICATION(sent);
+#if defined(PERF_STATS_ENABLE)
+        if(notificationsInFlight > notificationStats.maxInFlight)
+        {
+            notificationStats.maxInFlight = notificationsInFlight;
+        }
+#endif /* PERF_STATS_ENABLE */
+    }
+}
+
+#if defined(NOTIFICATION_BATCHING)
+/*----------------------------------------------------------------------------
+ *  NAME
+ *      notificationsWaiting
+ *
+ *  DESCRIPTION
+ *      Returns TRUE if any lane holds notifications not yet sent (or to be
+ *      sent again).
+ *---------------------------------------------------------------------------*/
+static bool notificationsWaiting(void)
+{
+    uint16 laneIndex;
+
+    for(laneIndex = 0; laneIndex < NOTIFICATION_LANES; laneIndex++)
+    {
+        if(notificationLanes[laneIndex].sendPosition !=
+           notificationLanes[laneIndex].writePosition)
+        {
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
+/*----------------------------------------------------------------------------
+ *  NAME
+ *      setBatchPending
+ *
+ *  DESCRIPTION
+ *      Turns the radio events that time the batches on or off.
+ *---------------------------------------------------------------------------*/
+static void setBatchPending(bool pending)
+{
+    if(pending != batchPending)
+    {
+        batchPending = pending;
+        LsRadioEventNotification(localData.st_ucid,
+                                 pending ? radio_event_first_tx : radio_event_none);
+    }
+}
+#endif /* NOTIFICATION_BATCHING */
+
+/****************************************************************************
+ *  NAME
+ *      findUnsentItem
+ *
+ *  DESCRIPTION
+ *      Returns the position of the newest record for the given handle that
+ *      has not been sent yet, or NO_ITEM if there is none.
+ ****************************************************************************/
+static uint16 findUnsentItem(NOTIFICATION_LANE_T *lane, uint16 handle)
+{
+    uint16 position = lane->sendPosition;
+    uint16 found = NO_ITEM;
+
+    while(position != lane->writePosition)
+    {
+        if(RECORD(lane, position)->handle == handle)
+        {
+            found = position;
+        }
+        position = nextRecord(lane, position);
+    }
+
+    return found;
+}
+
+/****************************************************************************
+ *  NAME
+ *      dropNewestUnsent
+ *
+ *  DESCRIPTION
+ *      Removes the newest record that has not been sent yet (if any) from a
+ *      lane, to make room for another.
+ *
+ *  RETURNS
+ *      TRUE if a record was removed.
+ ****************************************************************************/
+static bool dropNewestUnsent(NOTIFICATION_LANE_T *lane)
+{
+    uint16 position = lane->sendPosition;
+    uint16 next;
+
+    if(position == lane->writePosition)
+    {
+        return FALSE;
+    }
+
+    while((next = nextRecord(lane, position)) != lane->writePosition)
+    {
+        position = next;
+    }
+    lane->writePosition = position;
+
+    return TRUE;
+}
+
+/****************************************************************************
+ *  NAME
+ *      storeItem
+ *
+ *  DESCRIPTION
+ *      Copies a notification into the record at the given position.
+ ****************************************************************************/
+static void storeItem(NOTIFICATION_LANE_T *lane, uint16 position, uint16 handle, uint16 dataLenInBytes, uint16 *data, bool isRepeat)
+{
+    NOTIFICATION_RECORD *record = RECORD(lane, position);
+
+    record->handle = handle;
+    record->dataLenInBytes = dataLenInBytes;
+    
+    if(dataLenInBytes > 1)
+    {
+        MemCopy(RECORD_DATA(record), data, dataLenInBytes);
+    }
+    else
+    {
+        RECORD_DATA(record)[0] = ((*data) & 0xff);
     }
+
+    record->isRepeat = isRepeat;
+    record->bufferedTime = TimeGet32();
 }
 
 /****************************************************************************
@@ -113,46 +671,80 @@ static void sendNextNotification(void)
  *      bufferItem
  *
  *  DESCRIPTION
- *      Stores a notification in the local buffer, ready to send to the remote
- *      device. If there is no notification currently outstanding, then this
- *      function initiates sending the new notification.
+ *      Stores a notification in the handle's lane, ready to send to the
+ *      remote device. If there is room to send another notification, then
+ *      this function initiates sending the new notification.
+ *
+ *      A new value supersedes an unsent value for the same handle, which is
+ *      overwritten in its place in the queue, if the handle's policy is
+ *      COALESCE_LATEST, or if both are repeats of a held key. A slow or
+ *      reconnecting link then delivers the current state rather than a
+ *      backlog of stale values.
  ****************************************************************************/
-static bool bufferItem(uint16 handle, uint16 dataLenInBytes, uint16 *data, bool forceBuffering)
+static bool bufferItem(uint16 handle, uint16 dataLenInBytes, uint16 *data, bool forceBuffering, bool isRepeat)
 {
     bool itemBuffered = FALSE;  /* Assume that the buffering will fail */
-    
-    /* If there is no buffer space remaining but buffering is forced, overwrite the
-     * previous entry
-     */
-    if((notificationBufferRemaining() <= 1) &&
-       (forceBuffering))
+    const NOTIFICATION_POLICY_T *policy = findPolicy(handle);
+    NOTIFICATION_LANE_T *lane = &notificationLanes[policy->lane];
+    uint16 words = RECORD_WORDS(dataLenInBytes);
+    uint16 position;
+
+    if(dataLenInBytes > MAX_NOTIFICATION_DATA_LEN_BYTES)
     {
-        SET_PREV_POSITION(notificationWritePosition);
+        return FALSE;
     }
-    
-    /* If there is buffer space remaining... */
-    if(notificationBufferRemaining() > 1)
+
+    position = findUnsentItem(lane, handle);
+
+    if((position != NO_ITEM) &&
+       (RECORD(lane, position)->dataLenInBytes == dataLenInBytes) &&
+       ((policy->policy == COALESCE_LATEST) ||
+        (isRepeat && RECORD(lane, position)->isRepeat)))
     {
-        /* ... copy this notification into the buffer. */
-        notificationBuffer[notificationWritePosition].handle = handle;
-        notificationBuffer[notificationWritePosition].dataLenInBytes = dataLenInBytes;
-        
-        if(dataLenInBytes > 1)
+        /* Overwrite the superseded value rather than adding another item */
+        storeItem(lane, position, handle, dataLenInBytes, data, isRepeat);
+        itemBuffered = TRUE;
+    }
+    else
+    {
+        /* If there is no buffer space remaining but buffering is forced, overwrite the
+         * previous entry (if it has not been sent yet)
+         */
+        if(!recordFits(lane, words) && forceBuffering)
         {
-            MemCopy(notificationBuffer[notificationWritePosition].notification, data, dataLenInBytes);
+            dropNewestUnsent(lane);
         }
-        else
+
+        /* If there is buffer space remaining... */
+        if(recordFits(lane, words))
         {
-            notificationBuffer[notificationWritePosition].notification[0] = ((*data) & 0xff);
+            /* ... copy this notification into the buffer. */
+            position = placeRecord(lane, lane->writePosition, words);
+            storeItem(lane, position, handle, dataLenInBytes, data, isRepeat);
+
+            /* Attach the time-stamp of the key change that caused this item (if any) */
+            perfKeyStampTake(&RECORD(lane, position)->keyStamp);
+            
+            /* Move the write position past the record. */
+            lane->writePosition = position + words;
+            if((lane->size - lane->writePosition) < RECORD_WORDS(0))
+            {
+                lane->writePosition = 0;
+            }
+            wrapPositions(lane);
+            
+            /* Return that the item was buffered successfully. */
+            itemBuffered = TRUE;
+
+#if defined(PERF_STATS_ENABLE)
+            if(notificationLaneDepth(policy->lane) > notificationStats.maxDepth[policy->lane])
+            {
+                notificationStats.maxDepth[policy->lane] = notificationLaneDepth(policy->lane);
+            }
+#endif /* PERF_STATS_ENABLE */
         }
-        
-        /* Increment the buffer item count. */
-        SET_NEXT_POSITION(notificationWritePosition);
-        
-        /* Return that the item was buffered successfully. */
-        itemBuffered = TRUE;
+        /* else: not enough space to buffer this item */
     }
-    /* else: not enough space to buffer this item */
     
     /* If we are not currently scheduled to send a notification, trigger that now. */
     notificationSendNext();
@@ -174,7 +766,7 @@ static bool bufferItem(uint16 handle, uint16 dataLenInBytes, uint16 *data, bool
  ****************************************************************************/
 extern bool notificationForceBufferItem(uint16 handle, uint16 dataLenInBytes, uint16 *data)
 {
-    return bufferItem(handle, dataLenInBytes, data, TRUE);
+    return bufferItem(handle, dataLenInBytes, data, TRUE, FALSE);
 }
 
 /****************************************************************************
@@ -188,7 +780,22 @@ extern bool notificationForceBufferItem(uint16 handle, uint16 dataLenInBytes, ui
  ****************************************************************************/
 extern bool notificationBufferItem(uint16 handle, uint16 dataLenInBytes, uint16 *data)
 {
-    return bufferItem(handle, dataLenInBytes, data, FALSE);
+    return bufferItem(handle, dataLenInBytes, data, FALSE, FALSE);
+}
+
+/****************************************************************************
+ *  NAME
+ *      notificationRepeatItem
+ *
+ *  DESCRIPTION
+ *      Stores a repeat of a notification (e.g. for a held key) in the local
+ *      buffer. If the newest buffered item for the same handle is an earlier
+ *      repeat that has not been sent yet, it is replaced rather than another
+ *      item being added, so that a slow link does not let repeats pile up.
+ ****************************************************************************/
+extern bool notificationRepeatItem(uint16 handle, uint16 dataLenInBytes, uint16 *data)
+{
+    return bufferItem(handle, dataLenInBytes, data, FALSE, TRUE);
 }
 
 /****************************************************************************
@@ -202,25 +809,47 @@ extern bool notificationBufferItem(uint16 handle, uint16 dataLenInBytes, uint16
  ****************************************************************************/
 extern void notificationSendNext(void)
 {
-    /* If there is no notification currently scheduled to be sent... */
-    if((currentState == ALL_QUIET) &&
-       (localData.blockNotifications == FALSE))
+    /* If notifications may be sent at the moment... */
+    if(localData.blockNotifications == FALSE)
     {
+#if defined(NOTIFICATION_BATCHING)
+        /* While the firmware still holds notifications for the next
+         * connection event, leave the rest for the batch sent just before it.
+         */
+        if(batchPending && (notificationsInFlight > 0))
+        {
+            return;
+        }
+
+        sendNextNotification();
+        setBatchPending(notificationsWaiting());
+#else
         sendNextNotification();
+#endif /* NOTIFICATION_BATCHING */
     }
 }
 
 /****************************************************************************
  *  NAME
- *      notificationBufferRemaining
+ *      notificationLaneDepth
  *
  *  DESCRIPTION
- *      Return the number of empty notification buffer positions.
+ *      Return the number of notifications in a lane, including those sent
+ *      and awaiting confirmation.
  ****************************************************************************/
-extern uint16 notificationBufferRemaining(void)
+extern uint16 notificationLaneDepth(NOTIFICATION_LANE laneIndex)
 {
-    /* Return the number of empty buffer positions. */
-    return (MAX_BUFFERED_NOTIFICATIONS - NUM_BUFFERED_ITEMS(notificationReadPosition, notificationWritePosition));
+    NOTIFICATION_LANE_T *lane = &notificationLanes[laneIndex];
+    uint16 position = lane->readPosition;
+    uint16 depth = 0;
+
+    while(position != lane->writePosition)
+    {
+        depth++;
+        position = nextRecord(lane, position);
+    }
+
+    return depth;
 }
 
 /****************************************************************************
@@ -229,26 +858,92 @@ extern uint16 notificationBufferRemaining(void)
  *
  *  DESCRIPTION
  *      This function is called when a GATT_CHAR_VAL_IND_CFM is received from
- *      the firmware. If the transmission was successful, then the next buffered
- *      notification (if any) is readied for transmission.
+ *      the firmware. Confirmations arrive in the order in which notifications
+ *      were sent, so this is the confirmation of the oldest notification in
+ *      flight, unless the handle shows it to be for a notification or
+ *      indication sent by another module. If the transmission was successful,
+ *      the notification is removed from its lane. Otherwise it is sent
+ *      again, and so are the notifications sent after it from the same lane,
+ *      whatever their own results.
+ *
+ *      Confirmations from a link that has gone are ignored: the window is
+ *      emptied on disconnection (see notificationLinkLost()), and nothing is
+ *      sent on the next link until it is encrypted.
  ****************************************************************************/
-extern void notificationRegisterResult(bool transmitSucceeded)
+extern void notificationRegisterResult(uint16 cid, uint16 handle, bool transmitSucceeded)
 {
-    if(transmitSucceeded)
+    NOTIFICATION_LANE_T *lane;
+
+    if((cid != localData.st_ucid) || (notificationsInFlight == 0))
     {
-        /* Success! Move the read position on one place. */
-        SET_NEXT_POSITION(notificationReadPosition);
+        return;
     }
 
-    currentState = ALL_QUIET;
-    
-    if(dropOnNextRegistration)
+    lane = &notificationLanes[inFlightLanes[inFlightOldest]];
+
+    if(RECORD(lane, lane->cfmPosition)->handle != handle)
     {
-        notificationDropAll();
-        dropOnNextRegistration = FALSE;
+        /* Not the confirmation of a buffered notification */
+        return;
+    }
+
+    notificationsInFlight--;
+    if(++inFlightOldest == NOTIFICATION_WINDOW)
+    {
+        inFlightOldest = 0;
+    }
+    lane->inFlight--;
+
+    if(lane->cfmPosition == lane->readPosition)
+    {
+        if(transmitSucceeded)
+        {
+            /* Success! Move the read position on one record. */
+            lane->readPosition = nextRecord(lane, lane->readPosition);
+            COUNT_NOTIFICATION(confirmed);
+        }
+        else
+        {
+            /* Send it again, followed by the rest in their original order */
+            lane->sendPosition = lane->readPosition;
+            COUNT_NOTIFICATION(rejected);
+        }
+    }
+    /* else: this notification followed a rejected one, and will be sent again */
+
+    lane->cfmPosition = nextRecord(lane, lane->cfmPosition);
+
+    if(lane->inFlight == 0)
+    {
+        lane->cfmPosition = lane->readPosition;
     }
 }
 
+/****************************************************************************
+ *  NAME
+ *      notificationLinkLost
+ *
+ *  DESCRIPTION
+ *      This function is called on disconnection. The notifications in flight
+ *      will never be confirmed, so the window is emptied and they are left in
+ *      their lanes to be sent again on the next link (unless dropped).
+ ****************************************************************************/
+extern void notificationLinkLost(void)
+{
+    uint16 laneIndex;
+    NOTIFICATION_LANE_T *lane;
+
+    for(laneIndex = 0; laneIndex < NOTIFICATION_LANES; laneIndex++)
+    {
+        lane = &notificationLanes[laneIndex];
+        lane->sendPosition = lane->readPosition;
+        lane->cfmPosition = lane->readPosition;
+        lane->inFlight = 0;
+    }
+    notificationsInFlight = 0;
+    inFlightOldest = 0;
+}
+
 /****************************************************************************
  *  NAME
  *      notificationDropAll
@@ -259,13 +954,93 @@ extern void notificationRegisterResult(bool transmitSucceeded)
  ****************************************************************************/
 extern void notificationDropAll(void)
 {
-    if(currentState == ALL_QUIET)
+    uint16 laneIndex;
+    NOTIFICATION_LANE_T *lane;
+
+    for(laneIndex = 0; laneIndex < NOTIFICATION_LANES; laneIndex++)
     {
-        notificationWritePosition = 0;
-        notificationReadPosition = 0;
+        lane = &notificationLanes[laneIndex];
+        lane->writePosition = 0;
+        lane->readPosition = 0;
+        lane->sendPosition = 0;
+        lane->cfmPosition = 0;
+        lane->inFlight = 0;
     }
-    else
+    notificationsInFlight = 0;
+    inFlightOldest = 0;
+    lowLaneWait = 0;
+}
+
+#if defined(NOTIFICATION_BATCHING)
+/****************************************************************************
+ *  NAME
+ *      notificationBatchPending
+ *
+ *  DESCRIPTION
+ *      Return TRUE if notifications are waiting to be sent just before the
+ *      next connection event.
+ ****************************************************************************/
+extern bool notificationBatchPending(void)
+{
+    return batchPending;
+}
+
+/****************************************************************************
+ *  NAME
+ *      notificationSendBatch
+ *
+ *  DESCRIPTION
+ *      This function is called just before a connection event starts. It
+ *      sends the notifications waiting (as many as NOTIFICATION_WINDOW
+ *      allows), so that they all go out in that connection event.
+ ****************************************************************************/
+extern void notificationSendBatch(void)
+{
+#if defined(PERF_STATS_ENABLE)
+    uint32 sent = notificationStats.sent;
+#endif /* PERF_STATS_ENABLE */
+
+    if(!batchPending || localData.blockNotifications)
+    {
+        return;
+    }
+
+    sendNextNotification();
+    setBatchPending(notificationsWaiting());
+
+#if defined(PERF_STATS_ENABLE)
+    if(notificationStats.sent != sent)
     {
-        dropOnNextRegistration = TRUE;
+        notificationStats.batches++;
+        notificationStats.batchSent += notificationStats.sent - sent;
     }
+#endif /* PERF_STATS_ENABLE */
+}
+
+/****************************************************************************
+ *  NAME
+ *      notificationCancelBatch
+ *
+ *  DESCRIPTION
+ *      This function is called on disconnection. Radio events end with the
+ *      link, so nothing waits for them any more.
+ ****************************************************************************/
+extern void notificationCancelBatch(void)
+{
+    batchPending = FALSE;
+}
+#endif /* NOTIFICATION_BATCHING */
+
+#if defined(PERF_STATS_ENABLE)
+/****************************************************************************
+ *  NAME
+ *      notificationGetStats
+ *
+ *  DESCRIPTION
+ *      Return the notification sending statistics.
+ ****************************************************************************/
+extern const NOTIFICATION_STATS_T *notificationGetStats(void)
+{
+    return &notificationStats;
 }
+#endif /* PERF_STATS_ENABLE */
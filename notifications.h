@@ -15,6 +15,36 @@
  *============================================================================*/
 #include <types.h>
 
+/*============================================================================
+ * Local Header Files
+ *============================================================================*/
+#include "configuration.h"
+
+/*============================================================================
+ * Public Definitions
+ *============================================================================*/
+/* The notification priority lanes, highest priority first */
+typedef enum {
+    NOTIFICATION_LANE_HIGH,     /* Input reports */
+    NOTIFICATION_LANE_LOW,      /* Background traffic: battery level, OTA data */
+
+    NOTIFICATION_LANES
+} NOTIFICATION_LANE;
+
+#if defined(PERF_STATS_ENABLE)
+/* Notification sending statistics */
+typedef struct {
+    uint32 sent;                /* Notifications handed to the firmware */
+    uint32 confirmed;           /* Notifications confirmed as sent */
+    uint32 rejected;            /* Notifications rejected (and sent again) */
+    uint32 expired;             /* Superseded notifications dropped unsent as too old */
+    uint16 maxInFlight;         /* Most notifications awaiting confirmation at once */
+    uint16 maxDepth[NOTIFICATION_LANES];    /* Most notifications held in each lane */
+    uint32 batches;             /* Batches sent just before a connection event */
+    uint32 batchSent;           /* Notifications sent in those batches */
+} NOTIFICATION_STATS_T;
+#endif /* PERF_STATS_ENABLE */
+
 /*============================================================================
  * Public Function Implementations
  *============================================================================*/
@@ -22,13 +52,33 @@
 extern bool notificationBufferItem(uint16 handle, uint16 dataLenInBytes, uint16 *data);
 /* Force buffering a notification to send to the remote device (overwrites previously-buffered data). */
 extern bool notificationForceBufferItem(uint16 handle, uint16 dataLenInBytes, uint16 *data);
+/* Buffer a repeated notification, replacing an earlier repeat that has not been sent yet. */
+extern bool notificationRepeatItem(uint16 handle, uint16 dataLenInBytes, uint16 *data);
 /* Send the next notification from the buffer (if any). */
 extern void notificationSendNext(void);
-/* Get the number of buffer slots remaining for notifcations. */
-extern uint16 notificationBufferRemaining(void);
-/* Register the result of the last notification-send attempt. */
-extern void notificationRegisterResult(bool transmitSucceeded);
+/* Get the number of notifications held in a lane (including those in flight). */
+extern uint16 notificationLaneDepth(NOTIFICATION_LANE lane);
+/* Register the result of a notification-send attempt (confirmed in send order). */
+extern void notificationRegisterResult(uint16 cid, uint16 handle, bool transmitSucceeded);
+/* The link has gone; the notifications in flight will be sent again */
+extern void notificationLinkLost(void);
 /* Clear all data from the buffers */
 extern void notificationDropAll(void);
+#if defined(NOTIFICATION_BATCHING)
+/* Notifications are waiting to be sent just before the next connection event */
+extern bool notificationBatchPending(void);
+/* Send the waiting notifications; the next connection event is about to start */
+extern void notificationSendBatch(void);
+/* The link has gone; stop waiting for connection events */
+extern void notificationCancelBatch(void);
+#else
+#define notificationBatchPending()  (FALSE)
+#define notificationSendBatch()
+#define notificationCancelBatch()
+#endif /* NOTIFICATION_BATCHING */
+#if defined(PERF_STATS_ENABLE)
+/* Read the notification sending statistics */
+extern const NOTIFICATION_STATS_T *notificationGetStats(void);
+#endif /* PERF_STATS_ENABLE */
 
 #endif /* _NOTIFICATIONS_H */
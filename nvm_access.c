@@ -22,6 +22,7 @@
 
 #include "nvm_access.h"
 #include "i2c_comms.h"
+#include "perf_stats.h"
 
 /*=============================================================================*
  *  Public Function Implementations
@@ -52,6 +53,7 @@ extern sys_status Nvm_Read(uint16* buffer, uint16 length, uint16 offset)
      */
     sys_status res;
     res = NvmRead(buffer, length, offset);
+    perfCountNvmAccess();
     
     /* Disable NVM now to save power after read operation */
     Nvm_Disable();
@@ -83,6 +85,7 @@ extern sys_status Nvm_Write(uint16* buffer, uint16 length, uint16 offset)
      */
     sys_status res;
     res = NvmWrite(buffer, length, offset);
+    perfCountNvmAccess();
     
     /* Disable NVM now to save power after write operation */
     Nvm_Disable();
@@ -19,43 +19,48 @@
 #include <status.h>
 #include <nvm.h>
 
+/*=============================================================================*
+ *  Local Header Files
+ *============================================================================*/
+
+#include "bond_table.h"
+
 /* Magic value to check the validity of NVM region used by the application */
-#define NVM_SANITY_MAGIC                    (0x1357)
+#define NVM_SANITY_MAGIC                    (0x1358)
+
+/* Number of words of NVM given to the application (NVM_SIZE in the .keyr
+ * files)
+ */
+#define NVM_MAX_APP_MEMORY_WORDS            (0x0080)
 
 /* NVM offset for NVM sanity word */
 #define NVM_OFFSET_SANITY_WORD              (0)
 
-/* NVM offset for bonded flag */
-#define NVM_OFFSET_BONDED_FLAG              (NVM_OFFSET_SANITY_WORD + 1)
-
-/* NVM offset for bonded device bluetooth address */
-#define NVM_OFFSET_BONDED_ADDR              (NVM_OFFSET_BONDED_FLAG + \
-                                             sizeof(localData.bonded))
-
-/* NVM offset for diversifier */
-#define NVM_OFFSET_SM_DIV                   (NVM_OFFSET_BONDED_ADDR + \
-                                             sizeof(localData.bonded_bd_addr))
+/* NVM offset for the last diversifier issued by the Security Manager (the
+ * diversifier of each host is kept in the bond table)
+ */
+#define NVM_OFFSET_SM_DIV                   (NVM_OFFSET_SANITY_WORD + 1)
 
-/* NVM offset for IRK */
-#define NVM_OFFSET_SM_IRK                   (NVM_OFFSET_SM_DIV + \
+/* NVM offset for the bond table */
+#define NVM_OFFSET_BOND_TABLE               (NVM_OFFSET_SM_DIV + \
                                              sizeof(localData.diversifier))
 
 #if defined(IR_PROTOCOL_IRDB) || defined(IR_PROTOCOL_NEC) || defined(IR_PROTOCOL_RC5)
 /* NVM offset for IR controlled device */
-#define NVM_OFFSET_IR_CONTROLLED_DEVICE    (NVM_OFFSET_SM_IRK + \
-                                             sizeof(localData.controlledDevice))
+#define NVM_OFFSET_IR_CONTROLLED_DEVICE     (NVM_OFFSET_BOND_TABLE + \
+                                             BOND_TABLE_NVM_WORDS)
 
 /* Number of words of NVM used by core application. Memory used by supported 
  * services is not taken into consideration here.
  */
 #define N_APP_USED_NVM_WORDS                (NVM_OFFSET_IR_CONTROLLED_DEVICE + \
-                                             MAX_WORDS_IRK)
+                                             sizeof(localData.controlledDevice))
 #else
 /* Number of words of NVM used by core application. Memory used by supported 
  * services is not taken into consideration here.
  */
-#define N_APP_USED_NVM_WORDS                (NVM_OFFSET_SM_DIV + \
-                                             MAX_WORDS_IRK)
+#define N_APP_USED_NVM_WORDS                (NVM_OFFSET_BOND_TABLE + \
+                                             BOND_TABLE_NVM_WORDS)
 #endif /* IR_PROTOCOL_IRDB || IR_PROTOCOL_NEC || IR_PROTOCOL_RC5 */
 /*=============================================================================*
  *  Public Function Prototypes
@@ -0,0 +1,978 @@
+/*******************************************************************************
+ *    Copyright (C) Cambridge Silicon Radio Limited 2013
+ *
+ * FILE
+ *    perf_stats.c
+ *
+ *  DESCRIPTION
+ *    Collects performance statistics about the application, so that the cost
+ *    of a change can be measured instead of estimated. The module is only
+ *    compiled in when PERF_STATS_ENABLE is defined; the report is written to
+ *    the debug UART when DEBUG_ENABLE is also defined.
+ *
+ ******************************************************************************/
+
+/*=============================================================================
+ *  SDK Header Files
+ *============================================================================*/
+#include <types.h>
+#include <mem.h>
+
+/*=============================================================================
+ *  Local Header Files
+ *============================================================================*/
+#include "perf_stats.h"
+#include "app_gatt.h"
+#include "remote.h"
+#include "state.h"
+#include "notifications.h"
+
+#if defined(PERF_STATS_ENABLE)
+
+/*=============================================================================
+ *  Private Definitions
+ *============================================================================*/
+/* Number of background ticks (15 seconds each) between reports */
+#ifndef PERF_REPORT_TICKS
+#define PERF_REPORT_TICKS           (4)
+#endif /* PERF_REPORT_TICKS */
+
+/* Current figures for the energy estimate. The state currents are the
+ * average draw between radio events (deep sleep plus anything the state
+ * keeps powered); radio events, NVM/I2C transactions and PIO controller
+ * wake-ups are charged separately, per event, in nanocoulombs.
+ */
+#ifndef PERF_CURRENT_SLEEP_UA
+#define PERF_CURRENT_SLEEP_UA       (5)     /* INIT, advertising, idle, connected idle */
+#endif
+#ifndef PERF_CURRENT_MOTION_UA
+#define PERF_CURRENT_MOTION_UA      (1500)  /* Motion sensors powered */
+#endif
+#ifndef PERF_CURRENT_AUDIO_UA
+#define PERF_CURRENT_AUDIO_UA       (5000)  /* Audio codec powered */
+#endif
+#ifndef PERF_CHARGE_ADV_EVENT_NC
+#define PERF_CHARGE_ADV_EVENT_NC    (25000) /* Advertising on three channels */
+#endif
+#ifndef PERF_CHARGE_CONN_EVENT_NC
+#define PERF_CHARGE_CONN_EVENT_NC   (6000)  /* One connection event */
+#endif
+#ifndef PERF_CHARGE_NVM_ACCESS_NC
+#define PERF_CHARGE_NVM_ACCESS_NC   (2000)  /* One I2C EEPROM access */
+#endif
+#ifndef PERF_CHARGE_I2C_ACCESS_NC
+#define PERF_CHARGE_I2C_ACCESS_NC   (500)   /* One I2C register transaction */
+#endif
+#ifndef PERF_CHARGE_XAP_WAKE_NC
+#define PERF_CHARGE_XAP_WAKE_NC     (600)   /* One PIO controller wake-up */
+#endif
+
+/* Battery capacity for the battery-life estimate */
+#ifndef PERF_BATTERY_CAPACITY_MAH
+#define PERF_BATTERY_CAPACITY_MAH   (1000)
+#endif
+
+/* Interval between high duty cycle directed advertising events */
+#define PERF_DIRECTED_ADV_INTERVAL_US   (3750UL)
+
+/* A charge, held as whole microcoulombs plus a remainder in nanocoulombs */
+typedef struct {
+    uint32 uc;
+    uint16 nc;
+} PERF_CHARGE_T;
+
+/*=============================================================================
+ *  Private Data
+ *============================================================================*/
+/* Handling-cost statistics, one entry per event class */
+static PERF_EVENT_STATS_T eventStats[PERF_EVENT_CLASSES];
+/* The time at which handling of the current event started */
+static uint32 eventStartTime;
+/* Key-to-air latency statistics, one entry per key category */
+static PERF_KEY_STATS_T keyStats[PERF_KEY_CATEGORIES];
+/* The stamp of the last key change, until a notification takes it */
+static PERF_KEY_STAMP_T pendingKeyStamp;
+/* PIO controller key-scan statistics */
+static PERF_KEYSCAN_STATS_T keyscanStats;
+/* The PIO controller counters and the time at the last sample */
+static uint16 lastScanCount;
+static uint16 lastWakeCount;
+static uint32 lastKeyscanSampleTime;
+/* Set once a first key-scan sample has been taken */
+static bool keyscanSampled;
+/* Set if the PIO controller has been restarted since the last sample */
+static bool keyscanRestarted;
+/* Energy accounting statistics */
+static PERF_ENERGY_STATS_T energyStats;
+/* Start of the current energy accounting segment */
+static uint32 segmentStartTime;
+/* The interval of the current radio activity (us), and the time accounted
+ * against it which is not yet a whole radio event
+ */
+static uint32 advIntervalUs;
+static uint32 radioPeriodUs;
+static uint32 radioCarryUs;
+/* Connection parameter statistics */
+static PERF_CONN_PARAM_STATS_T connParamStats;
+/* The connection is on other than the preferred parameters, since when, and
+ * the time accumulated so far in this connection (ms)
+ */
+static bool connParamsOther;
+static uint32 connParamsOtherSince;
+static uint32 connParamsOtherMs;
+/* Background ticks since the last report */
+static uint16 reportTicks;
+
+/*=============================================================================
+ *  Private Function Implementations
+ *============================================================================*/
+/*-----------------------------------------------------------------------------*
+ *  NAME
+ *      keyCategory
+ *
+ *  DESCRIPTION
+ *      Classify the current application state for key-to-air latency.
+ *----------------------------------------------------------------------------*/
+static PERF_KEY_CATEGORY keyCategory(void)
+{
+    if(localData.state & STATE_CONNECTED)
+    {
+        return localData.blockNotifications ? PERF_KEY_RECONNECT_DELAY :
+                                              PERF_KEY_CONNECTED;
+    }
+
+    switch(localData.state)
+    {
+        case STATE_IDLE:
+            return PERF_KEY_IDLE;
+
+        case STATE_SLOW_ADVERT:
+            return PERF_KEY_SLOW_ADVERT;
+
+        case STATE_DIRECT_ADVERT:
+        case STATE_FAST_ADVERT:
+        case STATE_ADVERTISING:
+            return PERF_KEY_ADVERT;
+
+        default:
+            return PERF_KEY_OTHER;
+    }
+}
+
+/*-----------------------------------------------------------------------------*
+ *  NAME
+ *      latencyBucket
+ *
+ *  DESCRIPTION
+ *      Find the histogram bucket for a latency. Buckets 0 and 1 hold 0 and 1
+ *      units; above that, bucket (2 * n) starts at 2^n units and bucket
+ *      (2 * n + 1) at 1.5 * 2^n units.
+ *----------------------------------------------------------------------------*/
+static uint16 latencyBucket(uint32 latency)
+{
+    uint32 units = latency >> PERF_KEY_LATENCY_UNIT_SHIFT;
+    uint16 octave = 0;
+
+    while((units >> octave) > 1)
+    {
+        octave++;
+    }
+
+    if(octave >= (PERF_KEY_LATENCY_BUCKETS / 2))
+    {
+        return (PERF_KEY_LATENCY_BUCKETS - 1);
+    }
+
+    if(octave == 0)
+    {
+        /* 0 or 1 units */
+        return (uint16)units;
+    }
+
+    if((units >> (octave - 1)) & 1)
+    {
+        return ((octave << 1) + 1);
+    }
+
+    return (octave << 1);
+}
+
+/*-----------------------------------------------------------------------------*
+ *  NAME
+ *      latencyBucketLimit
+ *
+ *  DESCRIPTION
+ *      Get the (exclusive) upper limit of a histogram bucket in microseconds.
+ *      This is where latencyBucket() starts the next bucket.
+ *----------------------------------------------------------------------------*/
+static uint32 latencyBucketLimit(uint16 bucket)
+{
+    const uint16 octave = (bucket + 1) >> 1;
+    uint32 units = (1UL << octave);
+
+    if(((bucket + 1) & 1) && (octave > 0))
+    {
+        units += (1UL << (octave - 1));
+    }
+
+    return (units << PERF_KEY_LATENCY_UNIT_SHIFT);
+}
+
+/*-----------------------------------------------------------------------------*
+ *  NAME
+ *      stateIndex
+ *
+ *  DESCRIPTION
+ *      Map an application state to its energy accounting index.
+ *----------------------------------------------------------------------------*/
+static uint16 stateIndex(uint16 state)
+{
+    switch(state)
+    {
+        case STATE_CONNECTED_IDLE:
+            return (STATE_IDLE + 1);
+
+        case STATE_CONNECTED_MOTION:
+            return (STATE_IDLE + 2);
+
+        case STATE_CONNECTED_AUDIO:
+            return (STATE_IDLE + 3);
+
+        default:
+            return (state <= STATE_IDLE) ? state : STATE_INIT;
+    }
+}
+
+/*-----------------------------------------------------------------------------*
+ *  NAME
+ *      stateCurrent
+ *
+ *  DESCRIPTION
+ *      Get the current drawn (between radio events) in the given state (uA).
+ *----------------------------------------------------------------------------*/
+static uint16 stateCurrent(uint16 index)
+{
+    switch(index)
+    {
+        case (STATE_IDLE + 2):
+            return PERF_CURRENT_MOTION_UA;
+
+        case (STATE_IDLE + 3):
+            return PERF_CURRENT_AUDIO_UA;
+
+        default:
+            return PERF_CURRENT_SLEEP_UA;
+    }
+}
+
+/*-----------------------------------------------------------------------------*
+ *  NAME
+ *      currentRadioPeriod
+ *
+ *  DESCRIPTION
+ *      Get the time between radio events in the current state (us), or 0 if
+ *      the radio is not in use.
+ *----------------------------------------------------------------------------*/
+static uint32 currentRadioPeriod(void)
+{
+    if(localData.state & STATE_CONNECTED)
+    {
+        /* Connection interval is in units of 1.25ms. With slave latency, the
+         * radio wakes only every (latency + 1) intervals while there is no
+         * data to send.
+         */
+#if defined(LINK_ACTIVITY_LOW_LATENCY)
+        if(localData.link_active)
+        {
+            return (localData.actual_interval * 1250UL);
+        }
+#endif /* LINK_ACTIVITY_LOW_LATENCY */
+        return (localData.actual_interval * 1250UL) * (localData.actual_latency + 1);
+    }
+
+    switch(localData.state)
+    {
+        case STATE_DIRECT_ADVERT:
+        case STATE_FAST_ADVERT:
+        case STATE_SLOW_ADVERT:
+            return advIntervalUs;
+
+        default:
+            return 0;
+    }
+}
+
+/*-----------------------------------------------------------------------------*
+ *  NAME
+ *      addCharge
+ *
+ *  DESCRIPTION
+ *      Add (count * chargeNc) nanocoulombs to a charge without overflowing
+ *      the intermediate product.
+ *----------------------------------------------------------------------------*/
+static void addCharge(PERF_CHARGE_T *charge, uint32 count, uint16 chargeNc)
+{
+    const uint32 nc = (count % 1000) * chargeNc;
+
+    charge->uc += (count / 1000) * chargeNc;
+    charge->uc += nc / 1000;
+    charge->nc += (uint16)(nc % 1000);
+
+    if(charge->nc >= 1000)
+    {
+        charge->uc++;
+        charge->nc -= 1000;
+    }
+}
+
+/*-----------------------------------------------------------------------------*
+ *  NAME
+ *      readControllerCounter
+ *
+ *  DESCRIPTION
+ *      Read a 16-bit counter kept by the PIO controller. The controller
+ *      updates the two bytes separately, so read until two readings agree.
+ *----------------------------------------------------------------------------*/
+static uint16 readControllerCounter(volatile uint16 *counter)
+{
+    uint16 value;
+
+    do
+    {
+        value = *counter;
+    } while(value != *counter);
+
+    return value;
+}
+
+/*-----------------------------------------------------------------------------*
+ *  NAME
+ *      sampleKeyscan
+ *
+ *  DESCRIPTION
+ *      Sample the PIO controller scan and wake-up counters, and update the
+ *      key-scan statistics. Must be called more often than the counters
+ *      wrap (65536 scans, about 3 minutes at 32kHz).
+ *----------------------------------------------------------------------------*/
+static void sampleKeyscan(void)
+{
+    const uint32 now = PERF_TIME_NOW();
+    const uint16 scanCount = readControllerCounter(&PIO_SCAN_COUNT);
+    const uint16 wakeCount = readControllerCounter(&PIO_WAKE_COUNT);
+    uint16 scans;
+    uint16 wakes;
+    uint32 elapsedMs;
+
+    if(keyscanSampled)
+    {
+        /* Unsigned subtraction copes with the counters wrapping */
+        scans = scanCount - lastScanCount;
+        wakes = wakeCount - lastWakeCount;
+        elapsedMs = (now - lastKeyscanSampleTime) / 1000;
+
+        keyscanStats.scans += scans;
+        keyscanStats.wakes += wakes;
+        keyscanStats.timeMs += elapsedMs;
+
+        if(elapsedMs > 0)
+        {
+            keyscanStats.scansPerSecond = (uint16)(((uint32)scans * 1000) / elapsedMs);
+            keyscanStats.wakesPerSecond = (uint16)(((uint32)wakes * 1000) / elapsedMs);
+        }
+
+        /* The controller is not clocked while stopped, so the scan length can
+         * only be derived from a period of continuous scanning.
+         */
+        if((scans > 0) && !keyscanRestarted)
+        {
+            keyscanStats.cyclesPerScan = (uint16)(((PERF_PIO_CTRLR_CLOCK_HZ / 1000) * elapsedMs) / scans);
+        }
+    }
+
+    lastScanCount = scanCount;
+    lastWakeCount = wakeCount;
+    lastKeyscanSampleTime = now;
+    keyscanSampled = TRUE;
+    keyscanRestarted = FALSE;
+}
+
+#if defined(DEBUG_ENABLE)
+/*-----------------------------------------------------------------------------*
+ *  NAME
+ *      reportValue
+ *
+ *  DESCRIPTION
+ *      Write a labelled 32-bit value to the debug UART.
+ *----------------------------------------------------------------------------*/
+static void reportValue(const char *label, uint32 value)
+{
+    DebugWriteString(label);
+    DebugWriteUint32(value);
+}
+#endif /* DEBUG_ENABLE */
+
+/*=============================================================================
+ *  Public Function Implementations
+ *============================================================================*/
+
+/*-----------------------------------------------------------------------------*
+ *  NAME
+ *      perfInit
+ *
+ *  DESCRIPTION
+ *      Reset all the statistics.
+ *----------------------------------------------------------------------------*/
+extern void perfInit(void)
+{
+    MemSet(eventStats, 0, sizeof(eventStats));
+    MemSet(keyStats, 0, sizeof(keyStats));
+    MemSet(&keyscanStats, 0, sizeof(keyscanStats));
+    MemSet(&energyStats, 0, sizeof(energyStats));
+    MemSet(&connParamStats, 0, sizeof(connParamStats));
+    connParamsOther = FALSE;
+    connParamsOtherMs = 0;
+    segmentStartTime = PERF_TIME_NOW();
+    advIntervalUs = 0;
+    radioPeriodUs = 0;
+    radioCarryUs = 0;
+    keyscanSampled = FALSE;
+    keyscanRestarted = FALSE;
+    pendingKeyStamp.category = PERF_KEY_NONE;
+    eventStartTime = PERF_TIME_NOW();
+    reportTicks = 0;
+}
+
+/*-----------------------------------------------------------------------------*
+ *  NAME
+ *      perfEventBegin
+ *
+ *  DESCRIPTION
+ *      Mark the start of handling a firmware event. Events are delivered to
+ *      the application one at a time, so a single start time is sufficient.
+ *----------------------------------------------------------------------------*/
+extern void perfEventBegin(void)
+{
+    eventStartTime = PERF_TIME_NOW();
+}
+
+/*-----------------------------------------------------------------------------*
+ *  NAME
+ *      perfEventEnd
+ *
+ *  DESCRIPTION
+ *      Mark the end of handling a firmware event, and add the time taken to
+ *      the statistics of the given event class.
+ *----------------------------------------------------------------------------*/
+extern void perfEventEnd(PERF_EVENT_CLASS eventClass)
+{
+    /* Unsigned subtraction copes with the clock wrapping */
+    const uint32 elapsed = PERF_TIME_NOW() - eventStartTime;
+    PERF_EVENT_STATS_T *stats = &eventStats[eventClass];
+
+    stats->count++;
+    stats->totalTime += elapsed;
+    if(elapsed > stats->maxTime)
+    {
+        stats->maxTime = elapsed;
+    }
+}
+
+/*-----------------------------------------------------------------------------*
+ *  NAME
+ *      perfGetEventStats
+ *
+ *  DESCRIPTION
+ *      Read the statistics of the given event class.
+ *
+ *  RETURNS
+ *      A pointer to the statistics.
+ *----------------------------------------------------------------------------*/
+extern const PERF_EVENT_STATS_T *perfGetEventStats(PERF_EVENT_CLASS eventClass)
+{
+    return &eventStats[eventClass];
+}
+
+/*-----------------------------------------------------------------------------*
+ *  NAME
+ *      perfKeyEvent
+ *
+ *  DESCRIPTION
+ *      Record that the PIO controller has reported a key change, taken at the
+ *      given controller scan count. A snapshot that waited in the controller
+ *      FIFO is back-dated by the scans since it was taken (once the scan
+ *      length is known). The stamp is held until the resulting notification
+ *      is queued.
+ *----------------------------------------------------------------------------*/
+extern void perfKeyEvent(uint16 scanCount)
+{
+    const uint16 scansAgo = readControllerCounter(&PIO_SCAN_COUNT) - scanCount;
+    const uint32 cycles = (uint32)scansAgo * keyscanStats.cyclesPerScan;
+
+    pendingKeyStamp.time = PERF_TIME_NOW()
+                         - ((cycles / PERF_PIO_CTRLR_CLOCK_HZ) * 1000000UL)
+                         - (((cycles % PERF_PIO_CTRLR_CLOCK_HZ) * 1000) / (PERF_PIO_CTRLR_CLOCK_HZ / 1000));
+    pendingKeyStamp.category = keyCategory();
+}
+
+/*-----------------------------------------------------------------------------*
+ *  NAME
+ *      perfKeyEventDone
+ *
+ *  DESCRIPTION
+ *      Called once the key change has been processed. If it did not result in
+ *      a notification, the stamp is discarded so that it is not attached to a
+ *      later, unrelated notification.
+ *----------------------------------------------------------------------------*/
+extern void perfKeyEventDone(void)
+{
+    pendingKeyStamp.category = PERF_KEY_NONE;
+}
+
+/*-----------------------------------------------------------------------------*
+ *  NAME
+ *      perfKeyStampTake
+ *
+ *  DESCRIPTION
+ *      Hand the pending key change stamp to a notification being queued. Only
+ *      the first notification queued for a key change takes the stamp; any
+ *      others are given an empty stamp.
+ *----------------------------------------------------------------------------*/
+extern void perfKeyStampTake(PERF_KEY_STAMP_T *stamp)
+{
+    *stamp = pendingKeyStamp;
+    pendingKeyStamp.category = PERF_KEY_NONE;
+}
+
+/*-----------------------------------------------------------------------------*
+ *  NAME
+ *      perfKeyStampSent
+ *
+ *  DESCRIPTION
+ *      Called as a notification is passed to the firmware for transmission.
+ *      If it carries a key change stamp, the latency is recorded and the stamp
+ *      emptied, so that a retry is not counted again.
+ *----------------------------------------------------------------------------*/
+extern void perfKeyStampSent(PERF_KEY_STAMP_T *stamp)
+{
+    uint32 latency;
+    PERF_KEY_STATS_T *stats;
+
+    if(stamp->category >= PERF_KEY_CATEGORIES)
+    {
+        return;
+    }
+
+    latency = PERF_TIME_NOW() - stamp->time;
+    stats = &keyStats[stamp->category];
+
+    stats->count++;
+    stats->histogram[latencyBucket(latency)]++;
+    if(latency > stats->maxTime)
+    {
+        stats->maxTime = latency;
+    }
+
+    stamp->category = PERF_KEY_NONE;
+}
+
+/*-----------------------------------------------------------------------------*
+ *  NAME
+ *      perfGetKeyStats
+ *
+ *  DESCRIPTION
+ *      Read the key-to-air latency statistics of the given category.
+ *
+ *  RETURNS
+ *      A pointer to the statistics.
+ *----------------------------------------------------------------------------*/
+extern const PERF_KEY_STATS_T *perfGetKeyStats(PERF_KEY_CATEGORY category)
+{
+    return &keyStats[category];
+}
+
+/*-----------------------------------------------------------------------------*
+ *  NAME
+ *      perfKeyLatencyPercentile
+ *
+ *  DESCRIPTION
+ *      Estimate a latency percentile from the histogram. The result is the
+ *      upper limit of the bucket holding the percentile, capped at the
+ *      maximum latency seen, so it errs on the slow side by up to half an
+ *      octave.
+ *
+ *  RETURNS
+ *      The latency in microseconds, or 0 if there are no samples.
+ *----------------------------------------------------------------------------*/
+extern uint32 perfKeyLatencyPercentile(PERF_KEY_CATEGORY category, uint16 percent)
+{
+    const PERF_KEY_STATS_T *stats = &keyStats[category];
+    uint32 target;
+    uint32 seen = 0;
+    uint32 limit;
+    uint16 bucket;
+
+    if(stats->count == 0)
+    {
+        return 0;
+    }
+
+    /* Number of samples at or below the percentile, rounded up */
+    target = ((stats->count * percent) + 99) / 100;
+
+    for(bucket = 0; bucket < PERF_KEY_LATENCY_BUCKETS; bucket++)
+    {
+        seen += stats->histogram[bucket];
+        if(seen >= target)
+        {
+            break;
+        }
+    }
+
+    limit = latencyBucketLimit(bucket);
+
+    return (limit < stats->maxTime) ? limit : stats->maxTime;
+}
+
+/*-----------------------------------------------------------------------------*
+ *  NAME
+ *      perfGetKeyscanStats
+ *
+ *  DESCRIPTION
+ *      Read the PIO controller key-scan statistics.
+ *
+ *  RETURNS
+ *      A pointer to the statistics.
+ *----------------------------------------------------------------------------*/
+extern const PERF_KEYSCAN_STATS_T *perfGetKeyscanStats(void)
+{
+    return &keyscanStats;
+}
+
+/*-----------------------------------------------------------------------------*
+ *  NAME
+ *      perfKeyscanRestart
+ *
+ *  DESCRIPTION
+ *      Called just before the PIO controller is restarted, which clears its
+ *      scan and wake-up counters. The counts so far are accumulated, and the
+ *      next sample is taken relative to zero.
+ *----------------------------------------------------------------------------*/
+extern void perfKeyscanRestart(void)
+{
+    sampleKeyscan();
+
+    lastScanCount = 0;
+    lastWakeCount = 0;
+    keyscanRestarted = TRUE;
+}
+
+/*-----------------------------------------------------------------------------*
+ *  NAME
+ *      perfEnergyCheckpoint
+ *
+ *  DESCRIPTION
+ *      Account the time since the last checkpoint against the current state
+ *      and radio activity. Must be called before anything that changes them
+ *      (state, connection parameters, advertising interval), and at least
+ *      once per clock wrap (about 71 minutes), which the background tick
+ *      ensures.
+ *----------------------------------------------------------------------------*/
+extern void perfEnergyCheckpoint(void)
+{
+    const uint32 now = PERF_TIME_NOW();
+    const uint32 elapsedMs = (now - segmentStartTime) / 1000;
+    const uint32 elapsedUs = elapsedMs * 1000;
+    const uint32 period = currentRadioPeriod();
+    uint32 events;
+
+    /* Keep any sub-millisecond remainder for the next segment */
+    segmentStartTime += elapsedUs;
+
+    energyStats.timeMs += elapsedMs;
+    energyStats.stateTimeMs[stateIndex(localData.state)] += elapsedMs;
+
+    /* Part of a radio period is carried forward while the period is unchanged */
+    if(period != radioPeriodUs)
+    {
+        radioPeriodUs = period;
+        radioCarryUs = 0;
+    }
+
+    if(period != 0)
+    {
+        radioCarryUs += elapsedUs;
+        events = radioCarryUs / period;
+        radioCarryUs -= events * period;
+
+        if(localData.state & STATE_CONNECTED)
+        {
+            energyStats.connEvents += events;
+        }
+        else
+        {
+            energyStats.advEvents += events;
+        }
+    }
+}
+
+/*-----------------------------------------------------------------------------*
+ *  NAME
+ *      perfAdvertisingStart
+ *
+ *  DESCRIPTION
+ *      Advertising is (re)starting with the given interval. An interval of
+ *      0 indicates high duty cycle directed advertising.
+ *----------------------------------------------------------------------------*/
+extern void perfAdvertisingStart(uint32 intervalUs)
+{
+    perfEnergyCheckpoint();
+
+    advIntervalUs = (intervalUs != 0) ? intervalUs : PERF_DIRECTED_ADV_INTERVAL_US;
+}
+
+/*-----------------------------------------------------------------------------*
+ *  NAME
+ *      perfCountNvmAccess
+ *
+ *  DESCRIPTION
+ *      Count an NVM access.
+ *----------------------------------------------------------------------------*/
+extern void perfCountNvmAccess(void)
+{
+    energyStats.nvmAccesses++;
+}
+
+/*-----------------------------------------------------------------------------*
+ *  NAME
+ *      perfCountI2cAccess
+ *
+ *  DESCRIPTION
+ *      Count an I2C register transaction.
+ *----------------------------------------------------------------------------*/
+extern void perfCountI2cAccess(void)
+{
+    energyStats.i2cAccesses++;
+}
+
+/*-----------------------------------------------------------------------------*
+ *  NAME
+ *      perfGetEnergyStats
+ *
+ *  DESCRIPTION
+ *      Read the energy accounting statistics.
+ *
+ *  RETURNS
+ *      A pointer to the statistics.
+ *----------------------------------------------------------------------------*/
+extern const PERF_ENERGY_STATS_T *perfGetEnergyStats(void)
+{
+    return &energyStats;
+}
+
+/*-----------------------------------------------------------------------------*
+ *  NAME
+ *      perfEnergyEstimate
+ *
+ *  DESCRIPTION
+ *      Charge the configured current figures to the accounted state
+ *      residency and activity counts, and extrapolate the result to a daily
+ *      consumption and a battery life.
+ *----------------------------------------------------------------------------*/
+extern void perfEnergyEstimate(PERF_ENERGY_ESTIMATE_T *estimate)
+{
+    PERF_CHARGE_T charge = {0, 0};
+    uint32 seconds;
+    uint16 index;
+
+    perfEnergyCheckpoint();
+
+    /* uA * ms = nC */
+    for(index = 0; index < PERF_STATES; index++)
+    {
+        addCharge(&charge, energyStats.stateTimeMs[index], stateCurrent(index));
+    }
+
+    addCharge(&charge, energyStats.advEvents, PERF_CHARGE_ADV_EVENT_NC);
+    addCharge(&charge, energyStats.connEvents, PERF_CHARGE_CONN_EVENT_NC);
+    addCharge(&charge, energyStats.nvmAccesses, PERF_CHARGE_NVM_ACCESS_NC);
+    addCharge(&charge, energyStats.i2cAccesses, PERF_CHARGE_I2C_ACCESS_NC);
+    addCharge(&charge, keyscanStats.wakes, PERF_CHARGE_XAP_WAKE_NC);
+
+    estimate->chargeUc = charge.uc;
+    estimate->averageNa = 0;
+    estimate->uahPerDay = 0;
+    estimate->batteryDays = 0;
+
+    seconds = energyStats.timeMs / 1000;
+    if(seconds > 0)
+    {
+        /* uC / s = uA; split the division to keep the product in range */
+        estimate->averageNa = ((charge.uc / seconds) * 1000) +
+                              (((charge.uc % seconds) * 1000) / seconds);
+        estimate->uahPerDay = (estimate->averageNa * 24) / 1000;
+    }
+
+    if(estimate->uahPerDay > 0)
+    {
+        estimate->batteryDays = (PERF_BATTERY_CAPACITY_MAH * 1000UL) / estimate->uahPerDay;
+    }
+}
+
+/*-----------------------------------------------------------------------------*
+ *  NAME
+ *      perfConnParams
+ *
+ *  DESCRIPTION
+ *      Record whether the connection is using the preferred connection
+ *      parameters, to time how long it is not.
+ *----------------------------------------------------------------------------*/
+extern void perfConnParams(bool preferred)
+{
+    uint32 now = PERF_TIME_NOW();
+
+    if(connParamsOther)
+    {
+        connParamsOtherMs += (now - connParamsOtherSince) / 1000;
+    }
+
+    connParamsOther = !preferred;
+    connParamsOtherSince = now;
+}
+
+/*-----------------------------------------------------------------------------*
+ *  NAME
+ *      perfConnectionEnd
+ *
+ *  DESCRIPTION
+ *      Record the time the ended connection spent on other than the
+ *      preferred connection parameters.
+ *----------------------------------------------------------------------------*/
+extern void perfConnectionEnd(void)
+{
+    perfConnParams(TRUE);
+
+    connParamStats.connections++;
+    connParamStats.lastMs = connParamsOtherMs;
+    connParamStats.totalMs += connParamsOtherMs;
+    if(connParamsOtherMs > connParamStats.maxMs)
+    {
+        connParamStats.maxMs = connParamsOtherMs;
+    }
+
+    connParamsOther = FALSE;
+    connParamsOtherMs = 0;
+}
+
+/*-----------------------------------------------------------------------------*
+ *  NAME
+ *      perfGetConnParamStats
+ *
+ *  DESCRIPTION
+ *      Read the connection parameter statistics.
+ *
+ *  RETURNS
+ *      A pointer to the statistics.
+ *----------------------------------------------------------------------------*/
+extern const PERF_CONN_PARAM_STATS_T *perfGetConnParamStats(void)
+{
+    return &connParamStats;
+}
+
+/*-----------------------------------------------------------------------------*
+ *  NAME
+ *      perfBackgroundTick
+ *
+ *  DESCRIPTION
+ *      Called on each background tick. Samples the PIO controller counters
+ *      and emits the report every PERF_REPORT_TICKS ticks.
+ *----------------------------------------------------------------------------*/
+extern void perfBackgroundTick(void)
+{
+    sampleKeyscan();
+    perfEnergyCheckpoint();
+
+    reportTicks++;
+
+    if(reportTicks >= PERF_REPORT_TICKS)
+    {
+        reportTicks = 0;
+        perfReport();
+    }
+}
+
+/*-----------------------------------------------------------------------------*
+ *  NAME
+ *      perfReport
+ *
+ *  DESCRIPTION
+ *      Write the statistics to the debug UART. Does nothing unless
+ *      DEBUG_ENABLE is defined.
+ *----------------------------------------------------------------------------*/
+extern void perfReport(void)
+{
+#if defined(DEBUG_ENABLE)
+    uint16 eventClass;
+    uint16 category;
+    uint16 index;
+    PERF_ENERGY_ESTIMATE_T estimate;
+    const NOTIFICATION_STATS_T *notifyStats = notificationGetStats();
+
+    for(eventClass = 0; eventClass < PERF_EVENT_CLASSES; eventClass++)
+    {
+        reportValue("\r\nperf ev ", eventClass);
+        reportValue(" n=", eventStats[eventClass].count);
+        reportValue(" tot=", eventStats[eventClass].totalTime);
+        reportValue(" max=", eventStats[eventClass].maxTime);
+    }
+
+    for(category = 0; category < PERF_KEY_CATEGORIES; category++)
+    {
+        reportValue("\r\nperf key ", category);
+        reportValue(" n=", keyStats[category].count);
+        reportValue(" p50=", perfKeyLatencyPercentile(category, 50));
+        reportValue(" p99=", perfKeyLatencyPercentile(category, 99));
+        reportValue(" max=", keyStats[category].maxTime);
+    }
+
+    reportValue("\r\nperf scan n=", keyscanStats.scans);
+    reportValue(" wake=", keyscanStats.wakes);
+    reportValue(" ms=", keyscanStats.timeMs);
+    reportValue(" scan/s=", keyscanStats.scansPerSecond);
+    reportValue(" wake/s=", keyscanStats.wakesPerSecond);
+    reportValue(" clk/scan=", keyscanStats.cyclesPerScan);
+
+    reportValue("\r\nperf notify sent=", notifyStats->sent);
+    reportValue(" conf=", notifyStats->confirmed);
+    reportValue(" rej=", notifyStats->rejected);
+    reportValue(" exp=", notifyStats->expired);
+    reportValue(" batch=", notifyStats->batches);
+    reportValue(" batched=", notifyStats->batchSent);
+    reportValue(" inflight=", notifyStats->maxInFlight);
+    reportValue(" high=", notificationLaneDepth(NOTIFICATION_LANE_HIGH));
+    reportValue(" max=", notifyStats->maxDepth[NOTIFICATION_LANE_HIGH]);
+    reportValue(" low=", notificationLaneDepth(NOTIFICATION_LANE_LOW));
+    reportValue(" max=", notifyStats->maxDepth[NOTIFICATION_LANE_LOW]);
+
+    reportValue("\r\nperf connparam n=", connParamStats.connections);
+    reportValue(" last=", connParamStats.lastMs);
+    reportValue(" max=", connParamStats.maxMs);
+    reportValue(" tot=", connParamStats.totalMs);
+
+    perfEnergyEstimate(&estimate);
+    for(index = 0; index < PERF_STATES; index++)
+    {
+        reportValue("\r\nperf state ", index);
+        reportValue(" ms=", energyStats.stateTimeMs[index]);
+    }
+    reportValue("\r\nperf energy adv=", energyStats.advEvents);
+    reportValue(" conn=", energyStats.connEvents);
+    reportValue(" nvm=", energyStats.nvmAccesses);
+    reportValue(" i2c=", energyStats.i2cAccesses);
+    reportValue(" uC=", estimate.chargeUc);
+    reportValue(" nA=", estimate.averageNa);
+    reportValue(" uAh/day=", estimate.uahPerDay);
+    reportValue(" days=", estimate.batteryDays);
+#endif /* DEBUG_ENABLE */
+}
+
+#endif /* PERF_STATS_ENABLE */
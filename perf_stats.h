@@ -0,0 +1,211 @@
+/*******************************************************************************
+ *    Copyright (C) Cambridge Silicon Radio Limited 2013
+ *
+ * FILE
+ *    perf_stats.h
+ *
+ *  DESCRIPTION
+ *    Header file for the performance statistics module. All timing taken by
+ *    this module goes through PERF_TIME_NOW(), so that a build which does not
+ *    run on the chip can supply its own (virtual) clock.
+ *
+ ******************************************************************************/
+#ifndef _PERF_STATS_H
+#define _PERF_STATS_H
+
+/*=============================================================================
+ *  SDK Header Files
+ *============================================================================*/
+#include <types.h>
+#include <time.h>
+
+/*=============================================================================
+ *  Local Header Files
+ *============================================================================*/
+#include "configuration.h"
+
+/*=============================================================================
+ *  Public Definitions
+ *============================================================================*/
+
+/* The time source (in microseconds) used for all measurements. A build
+ * variant may define this before including this file to replace the
+ * on-chip clock.
+ */
+#ifndef PERF_TIME_NOW
+#define PERF_TIME_NOW()             TimeGet32()
+#endif /* PERF_TIME_NOW */
+
+/* The classes of firmware event whose handling cost is measured */
+typedef enum {
+    PERF_EVENT_LM,              /* AppProcessLmEvent() */
+    PERF_EVENT_SYSTEM,          /* AppProcessSystemEvent() */
+
+    PERF_EVENT_CLASSES
+} PERF_EVENT_CLASS;
+
+/* The conditions under which a key change was seen. Key-to-air latency is
+ * accumulated separately for each.
+ */
+typedef enum {
+    PERF_KEY_CONNECTED,         /* Connected, notifications flowing */
+    PERF_KEY_RECONNECT_DELAY,   /* Connected, within the post-reconnection delay */
+    PERF_KEY_IDLE,              /* Not connected or advertising; must reconnect */
+    PERF_KEY_SLOW_ADVERT,       /* Slow undirected advertising */
+    PERF_KEY_ADVERT,            /* Fast or directed advertising */
+    PERF_KEY_OTHER,             /* Any other state */
+
+    PERF_KEY_CATEGORIES,
+    PERF_KEY_NONE = PERF_KEY_CATEGORIES /* The stamp does not hold a key change */
+} PERF_KEY_CATEGORY;
+
+/* The number of latency histogram buckets. The first two hold 0 and 1 units
+ * of 1024us; each of the others covers half an octave, up to 65535 units.
+ */
+#define PERF_KEY_LATENCY_BUCKETS    (32)
+/* log2 of the latency histogram unit in microseconds (1024us) */
+#define PERF_KEY_LATENCY_UNIT_SHIFT (10)
+
+/* Time-stamp of a key change, carried with the resulting notification */
+typedef struct {
+    uint32 time;                /* When the key change was seen */
+    uint16 category;            /* PERF_KEY_CATEGORY at that time */
+} PERF_KEY_STAMP_T;
+
+/* Key-to-air latency statistics for one category */
+typedef struct {
+    uint16 histogram[PERF_KEY_LATENCY_BUCKETS];
+    uint32 count;               /* Number of latencies recorded */
+    uint32 maxTime;             /* Longest latency (us) */
+} PERF_KEY_STATS_T;
+
+/* The PIO controller clock while key-scanning (Hz) */
+#ifndef PERF_PIO_CTRLR_CLOCK_HZ
+#define PERF_PIO_CTRLR_CLOCK_HZ     (32000UL)
+#endif /* PERF_PIO_CTRLR_CLOCK_HZ */
+
+/* PIO controller key-scan statistics. The totals cover everything since
+ * perfInit(); the rates cover the last sampling period (one background tick).
+ */
+typedef struct {
+    uint32 scans;               /* Key-matrix scans */
+    uint32 wakes;               /* XAP wake-ups by the PIO controller */
+    uint32 timeMs;              /* Time over which the totals were taken */
+    uint16 scansPerSecond;
+    uint16 wakesPerSecond;
+    uint16 cyclesPerScan;       /* Controller clocks per SCAN_LOOP iteration */
+} PERF_KEYSCAN_STATS_T;
+
+/* The number of application states tracked for energy accounting: the
+ * non-connected states (STATE_INIT to STATE_IDLE) and the three connected
+ * states.
+ */
+#define PERF_STATES                 (10)
+
+/* Activity counts and state residency, for the energy estimate */
+typedef struct {
+    uint32 timeMs;                      /* Total time accounted */
+    uint32 stateTimeMs[PERF_STATES];    /* Time spent in each state */
+    uint32 advEvents;                   /* Advertising events */
+    uint32 connEvents;                  /* Connection events */
+    uint32 nvmAccesses;                 /* NVM reads and writes */
+    uint32 i2cAccesses;                 /* I2C register transactions */
+} PERF_ENERGY_STATS_T;
+
+/* The energy estimate derived from PERF_ENERGY_STATS_T */
+typedef struct {
+    uint32 chargeUc;            /* Charge used over the accounted time (uC) */
+    uint32 averageNa;           /* Average current (nA) */
+    uint32 uahPerDay;           /* Extrapolated consumption (uAh per day) */
+    uint32 batteryDays;         /* Extrapolated battery life (days) */
+} PERF_ENERGY_ESTIMATE_T;
+
+/* Time spent on connection parameters other than the preferred ones */
+typedef struct {
+    uint32 connections;         /* Connections ended */
+    uint32 lastMs;              /* Time on other parameters in the last connection */
+    uint32 maxMs;               /* Longest time in any connection */
+    uint32 totalMs;             /* Total time in all connections */
+} PERF_CONN_PARAM_STATS_T;
+
+/* Handling-cost statistics for one class of event */
+typedef struct {
+    uint32 count;               /* Number of events handled */
+    uint32 totalTime;           /* Sum of the handling times (us) */
+    uint32 maxTime;             /* Longest single handling time (us) */
+} PERF_EVENT_STATS_T;
+
+/*=============================================================================
+ *  Public function prototypes
+ *============================================================================*/
+#if defined(PERF_STATS_ENABLE)
+
+/* Reset all the statistics */
+extern void perfInit(void);
+/* Mark the start of handling a firmware event */
+extern void perfEventBegin(void);
+/* Mark the end of handling a firmware event of the given class */
+extern void perfEventEnd(PERF_EVENT_CLASS eventClass);
+/* Read the statistics of the given event class */
+extern const PERF_EVENT_STATS_T *perfGetEventStats(PERF_EVENT_CLASS eventClass);
+/* Record that the PIO controller has reported a key change (at a scan count) */
+extern void perfKeyEvent(uint16 scanCount);
+/* Discard the key change stamp if no notification has taken it */
+extern void perfKeyEventDone(void);
+/* Hand the pending key change stamp (if any) to a notification being queued */
+extern void perfKeyStampTake(PERF_KEY_STAMP_T *stamp);
+/* A notification carrying the stamp is being sent; record its latency */
+extern void perfKeyStampSent(PERF_KEY_STAMP_T *stamp);
+/* Read the key-to-air latency statistics of the given category */
+extern const PERF_KEY_STATS_T *perfGetKeyStats(PERF_KEY_CATEGORY category);
+/* Get the latency (us) below which the given percentage of samples fall */
+extern uint32 perfKeyLatencyPercentile(PERF_KEY_CATEGORY category, uint16 percent);
+/* Read the PIO controller key-scan statistics */
+extern const PERF_KEYSCAN_STATS_T *perfGetKeyscanStats(void);
+/* The PIO controller is about to be restarted (its counters will be cleared) */
+extern void perfKeyscanRestart(void);
+/* Account the time up to now against the current state and radio activity */
+extern void perfEnergyCheckpoint(void);
+/* Advertising is (re)starting with the given interval (us, 0 for directed) */
+extern void perfAdvertisingStart(uint32 intervalUs);
+/* Count an NVM access */
+extern void perfCountNvmAccess(void);
+/* Count an I2C register transaction */
+extern void perfCountI2cAccess(void);
+/* Read the energy accounting statistics */
+extern const PERF_ENERGY_STATS_T *perfGetEnergyStats(void);
+/* Estimate the charge used and battery life from the statistics */
+extern void perfEnergyEstimate(PERF_ENERGY_ESTIMATE_T *estimate);
+/* The connection is using (or not using) the preferred parameters */
+extern void perfConnParams(bool preferred);
+/* The connection has ended */
+extern void perfConnectionEnd(void);
+/* Read the connection parameter statistics */
+extern const PERF_CONN_PARAM_STATS_T *perfGetConnParamStats(void);
+/* Called on each background tick; emits the report every PERF_REPORT_TICKS */
+extern void perfBackgroundTick(void);
+/* Write the statistics to the debug UART (DEBUG_ENABLE builds only) */
+extern void perfReport(void);
+
+#else /* PERF_STATS_ENABLE */
+
+#define perfInit()
+#define perfEventBegin()
+#define perfEventEnd(_c_)
+#define perfKeyEvent(_s_)
+#define perfKeyEventDone()
+#define perfKeyStampTake(_s_)
+#define perfKeyStampSent(_s_)
+#define perfKeyscanRestart()
+#define perfEnergyCheckpoint()
+#define perfAdvertisingStart(_i_)
+#define perfCountNvmAccess()
+#define perfCountI2cAccess()
+#define perfConnParams(_p_)
+#define perfConnectionEnd()
+#define perfBackgroundTick()
+#define perfReport()
+
+#endif /* PERF_STATS_ENABLE */
+
+#endif /* _PERF_STATS_H */
@@ -23,8 +23,25 @@
 .equ BUFFER_BASE  ,0x30 ; Pointer to valid dual port RAM with XAP
 .equ SEM_FROM_XAP ,BUFFER_BASE    ; The semaphore from the XAP
 .equ SEM_INTO_XAP ,SEM_FROM_XAP+2 ; The semaphore into the XAP
-.equ KEYPTR_BASE  ,SEM_INTO_XAP+2 ; Pointer to shared dual port 0 RAM with XAP
-.equ KEYPTR_BASE2 ,KEYPTR_BASE+4  ; Pointer to shared dual port 1 RAM with XAP
+.equ FIFO_WRITE   ,SEM_INTO_XAP+2 ; Next snapshot slot to be written (by the controller)
+.equ FIFO_READ    ,FIFO_WRITE+2   ; Next snapshot slot to be read (by the XAP)
+.equ SCAN_COUNT   ,FIFO_READ+2    ; 16-bit count of key-matrix scans (read by the XAP)
+.equ WAKE_COUNT   ,SCAN_COUNT+2   ; 16-bit count of XAP wake-ups (read by the XAP)
+.equ DEBOUNCE_DEPTH ,WAKE_COUNT+2 ; Debounce depth (written by the XAP)
+.equ FIFO_BASE    ,DEBOUNCE_DEPTH+2 ; Key-scan snapshot FIFO, shared with the XAP
+
+; Each snapshot holds the SCAN_COUNT (LSB first) of the scan that produced it,
+; followed by the debounced state of the 4 rows. One slot is always left
+; empty, so up to (FIFO_SLOTS - 1) snapshots can be waiting for the XAP.
+.equ SNAPSHOT_SIZE ,6
+.equ FIFO_SLOTS    ,4
+
+; Debounce state, private to the controller (register banks 2 and 3).
+; One byte per row, indexed by R2:
+.equ DEBOUNCE_CANDIDATE ,0x10     ; Row reading waiting to become stable
+.equ DEBOUNCE_COUNT     ,0x14     ; Further scans the candidate must be seen for
+.equ DEBOUNCE_STATE     ,0x18     ; Debounced (reported) row state
+.equ DEBOUNCE_END       ,0x1c
 
 .equ KEY_MASK     ,0x1f
 
@@ -34,19 +51,17 @@
 
 ; Data-validity masks - indicate to the XAP the reason for the interrupt.
 ; This reason value is written into XAP_INT_INFO.
-; Bit 0x1 is used to indicate which buffer holds the data for this interrupt.
-.equ BUFFER_MASK     ,0x01    ; If set, the data is in buffer 2; else: buffer 1.
 .equ BUTTONS_VALID   ,0x02    ; The XAP has been interrupted due to new button data.
 
 ; --- Register usage (when scanning keys): ---
-; Bank 1, R0 - if set, wake the XAP
+; Bank 1, R0 - if set, wake the XAP; also the snapshot source pointer
 ; Bank 1, R1 - points to current write location
-; Bank 1, R2 (unused)
+; Bank 1, R2 - index of the current row (for the debounce state)
 ; Bank 1, R3 - indicates change in key matrix during scan (temporary)
-; Bank 1, R4 (unused)
+; Bank 1, R4 - the snapshot slot that follows FIFO_WRITE
 ; Bank 1, R5 - temp button state
-; Bank 1, R6 - the current valid buffer (0 or 1)
-; Bank 1, R7 - points to start of current shared RAM location
+; Bank 1, R6 - set until the first stable key state has been reported
+; Bank 1, R7 - set if a change to any row is still being debounced
     
     
 
@@ -71,6 +86,26 @@ KEYSCAN_INITIALISATION:
     inc R1
     mov  @R1, #0              ; MSB of word
 
+    ; Clear the scan and wake-up counters
+    mov R1, #SCAN_COUNT
+    mov  @R1, #0
+    inc R1
+    mov  @R1, #0
+    mov R1, #WAKE_COUNT
+    mov  @R1, #0
+    inc R1
+    mov  @R1, #0
+
+    ; Empty the snapshot FIFO
+    mov R1, #FIFO_WRITE
+    mov  @R1, #0
+    inc R1
+    mov  @R1, #0
+    mov R1, #FIFO_READ
+    mov  @R1, #0
+    inc R1
+    mov  @R1, #0
+
 ;
 ; Set all the ROW PIOs:
     setb    P2.7            ; Set PIO 0 high
@@ -85,16 +120,23 @@ KEYSCAN_INITIALISATION:
     setb    P3.4
     
     mov     R3, #0              ; clear the temp "button pressed" record
-    
-; There are 2 copies of the scanned keys in the shared RAM between the
-; PIO Controller and the XAP. They flip between one buffer and the other so that
-; the first set of scan keys are not over written by the scanning of the 2nd 
-; set of keys. The first word in the buffer defines the which buffer
-; contains the latest scanned keys.
-    
-    ; Record that we will be using buffer 0 first.
-    mov     R7, #KEYPTR_BASE
-    mov     R6, #0
+
+    ; Clear the debounce state: no keys pressed, nothing pending.
+    mov     R1, #DEBOUNCE_CANDIDATE
+CLEAR_DEBOUNCE:
+    mov     @R1, #0
+    inc     R1
+    cjne    R1, #DEBOUNCE_END, CLEAR_DEBOUNCE
+    
+    ; The first stable key state is always reported, even if no key is down:
+    ; the XAP may have restarted the controller on a key-matrix edge that
+    ; turned out to be a glitch.
+    mov     R6, #1
+    
+; Each change in the debounced key state is recorded as a snapshot in a FIFO
+; in the shared RAM, so that a press and release that both happen before the
+; XAP responds are both seen. The XAP is woken only when the FIFO goes from
+; empty to non-empty, and reads every waiting snapshot in one go.
     
 SCAN_LOOP:
     mov     R0, #0  ; clear the "wake up XAP now" flag
@@ -117,10 +159,29 @@ BUTTON_SCAN:
     ; the XAP by setting the appropriate semaphore.
     mov R1, #SEM_INTO_XAP     ; Load the semaphore location into R1
     mov  @R1, #CMD_DO_KEYSCAN ; Indicate the current activity
-    
-    ; Reset R1 to the start of the buffer (from R7)
-    mov     A, R7
-    mov     R1, A
+
+    ; Work out the slot that follows the write slot (into R4). If that is the
+    ; XAP's read slot then the FIFO is full: skip this scan, leaving any
+    ; change to be picked up once the XAP has caught up.
+    mov     R1, #FIFO_WRITE
+    mov     A, @R1
+    inc     A
+    cjne    A, #FIFO_SLOTS, FIFO_NEXT_SLOT
+    clr     A                   ; wrap back to the first slot
+FIFO_NEXT_SLOT:
+    mov     R4, A
+    mov     R1, #FIFO_READ
+    xrl     A, @R1
+    jnz     FIFO_HAS_ROOM
+    ljmp    END_SCAN_LOOP
+    
+FIFO_HAS_ROOM:
+    ; Count this scan, so that the XAP can measure the scan rate
+    mov     R1, #SCAN_COUNT
+    lcall   INC_COUNTER
+    
+    mov     R2, #0              ; Start with the debounce state of row 1
+    mov     R7, #0              ; No change is being debounced yet
 
     ; Row 1 (PIO 23)
     clr     P2.7                ; Set row low
@@ -145,61 +206,68 @@ BUTTON_SCAN:
     lcall   INVERT_AND_STORE    ; Store the value for this dummy row/column combination.
     
     ;***************************************************************************
-    ; All the column changes are now OR'ed together into R3. If a bit is set
-    ; in R3, then a button has been pressed.
+    ; R3 is set if the debounced state of any row has changed, i.e. a button
+    ; has been pressed or released.
     mov     A, R3       ; This is the current reading
     
 
-    jz      NO_BUTTON_CHANGE    ; if: a key is neither pressed nor released (A is zero), 
-                                ; then: do not wake the XAP this time round
-    mov     R0, #BUTTONS_VALID  ; else: wake the XAP (after the wheel scan)
-    mov     A, #0               ; Zero R3
-    mov     R3, A               
-    
-    ;
-    ; FALL THRU TO RECORDING BUTTON STATE
-    ;
-    
-    ;***************************************************************************
-NO_BUTTON_CHANGE:
-    ; Do nothing.
-    
-    ;
-    ; FALL THRU TO WAKING XAP
-    ;
-    
-CHECK_WAKE_XAP:
-    ; If R0 is set, we need to wake the XAP; otherwise, there is nothing
-    ; to report, so let it sleep.
-    mov     A, R0
-    jz      END_SCAN_LOOP   ; if R0 is not set, jump to END_SCAN_LOOP
-    
-    lcall WAKE_XAP          ; If we are here, call the routine to wake the XAP
-    
-    ;
-    ; FALL THRU TO SWITCH BUFFER
-    ;
-    
-SWITCH_BUFFER:
-    ; We have woken the XAP to process the new information. To avoid
-    ; over-writing the data just supplied, switch now to the other data
-    ; buffer.
-    
-    ; R7 holds the current data buffer. 
-    ; If this is not KEYPTR_BASE2, then jump to SWITCH_TO_BUFFER2
-    ; else: fall thru to SWITCH_TO_BUFFER1
+    jnz     RECORD_SNAPSHOT     ; if: a key is neither pressed nor released (A is zero), 
+    mov     A, R6               ; then: there is nothing to tell the XAP, unless
+    jz      NO_SNAPSHOT         ; the first stable state has yet to be reported
+    mov     A, R7               ; and no row is still being debounced.
+    jz      RECORD_SNAPSHOT
+NO_SNAPSHOT:
+    ljmp    END_SCAN_LOOP
+    
+RECORD_SNAPSHOT:
+    mov     R3, #0              ; else: zero R3, and record the new state
+    mov     R6, #0
     
-    cjne     R7, #KEYPTR_BASE2, SWITCH_TO_BUFFER2
+    ; Point R1 at the write slot: FIFO_BASE + (FIFO_WRITE * SNAPSHOT_SIZE)
+    mov     R1, #FIFO_WRITE
+    mov     A, @R1
+    rl      A                   ; A = slot * 2
+    mov     R5, A
+    rl      A                   ; A = slot * 4
+    add     A, R5               ; A = slot * 6
+    add     A, #FIFO_BASE
+    mov     R1, A
     
-SWITCH_TO_BUFFER1:
-     mov     R7, #KEYPTR_BASE   ; Record the new buffer start in R7.
-     mov     R6, #0             ; R6 holds the buffer 0/1 record.
-     ljmp    END_SCAN_LOOP      ; We are done here: jump to the end.
+    ; Time-stamp the snapshot with the scan count
+    mov     A, SCAN_COUNT
+    mov     @R1, A
+    inc     R1
+    mov     A, SCAN_COUNT+1
+    mov     @R1, A
+    inc     R1
+    
+    ; Copy in the debounced state of every row
+    mov     R0, #DEBOUNCE_STATE
+COPY_SNAPSHOT:
+    mov     A, @R0
+    mov     @R1, A
+    inc     R0
+    inc     R1
+    cjne    R0, #DEBOUNCE_END, COPY_SNAPSHOT
+    
+    ; Publish the snapshot by moving the write slot on (to R4). Keep the old
+    ; write slot in R5.
+    mov     R1, #FIFO_WRITE
+    mov     A, @R1
+    mov     R5, A
+    mov     A, R4
+    mov     @R1, A
+    
+    ; If the FIFO was empty until now, the XAP must be woken. Otherwise it
+    ; has yet to finish reading the FIFO, and will find this snapshot too.
+    mov     R1, #FIFO_READ
+    mov     A, @R1
+    xrl     A, R5
+    jnz     END_SCAN_LOOP
+    
+    mov     R0, #BUTTONS_VALID  ; Tell the XAP why it has been woken
+    lcall WAKE_XAP          ; and call the routine to wake the XAP
     
-SWITCH_TO_BUFFER2:
-     mov     R7, #KEYPTR_BASE2
-     mov     R6, #BUFFER_MASK
-     
     ; FALL THRU
     
 END_SCAN_LOOP:
@@ -217,35 +285,100 @@ WAKE_XAP:
     ; A button has been pressed or the wheel has been turned.
     ; Wake up the XAP with an interrupt.
     
-    mov     A, R6           ; Indicate to the XAP which buffer is valid
-    orl     A, R0           ; and the reason for the interrupt.
-    mov     XAP_INT_INFO, A
+    mov     A, R0           ; Indicate to the XAP the reason for the
+    mov     XAP_INT_INFO, A ; interrupt.
     
     mov     WAKEUP, #1      ; wake the XAP
     mov     WAKEUP, #0
+
+    mov     R1, #WAKE_COUNT ; Count the wake-up, so that the XAP can
+    lcall   INC_COUNTER     ; measure the wake-up rate
+    
+    ret                     ; end sub-routine
+
+;*******************************************************************************
+INC_COUNTER:
+    ; Increment the 16-bit (LSB first) counter pointed to by R1.
+    ; R1 is modified.
+    
+    inc     @R1             ; Increment the LSB
+    cjne    @R1, #0, INC_COUNTER_DONE ; If the LSB has not wrapped, we are done
+    inc     R1
+    inc     @R1             ; else: carry into the MSB
     
+INC_COUNTER_DONE:
     ret                     ; end sub-routine
     
 ;*******************************************************************************
 INVERT_AND_STORE:
-    ; Invert the "column" reading for the buttons and store the result (into R5)
-    ; The column reading is in the accumulator.
+    ; Invert the "column" reading for the buttons, debounce it, and store the
+    ; debounced row state (at DEBOUNCE_STATE).
+    ; The column reading is in the accumulator; R2 is the row index.
+    ;
+    ; A new reading only replaces the debounced state once it has been seen on
+    ; (DEBOUNCE_DEPTH + 1) consecutive scans; a reading that differs from the
+    ; one pending restarts the count. Contact bounce therefore never reaches
+    ; the XAP. R3 is set when the debounced state changes.
     
     cpl     A               ; Invert the bits (low -> high), so that a button
                             ; press is indicated by a bit being set.
     anl     A, #(KEY_MASK)  ; Mask off the uninteresting stuff from the rest
                             ; of the I/O port.
     
-    mov     R5, A           ; R5 = new reading for THIS column
-    mov     A, @R1          ; R1 = old reading for THIS column
-    xrl     A, R5           ; A = R1 ^ R5 (bitwise XOR, 0 if equal)
-    orl     A, R3           ; R3 marks which rows have changed for ANY column:
-    mov     R3, A           ; R3 = R3 | A (we really only care if it's 0 or not)
-    mov     A, R5           ; Store new column reading into XAP shared memory:
-    mov     @R1, A          ; R1 = R5 (old = new, for this column on next SCAN)
+    mov     R5, A           ; R5 = new reading for THIS row
+    
+    mov     A, R2
+    add     A, #DEBOUNCE_STATE
+    mov     R1, A           ; R1 -> debounced state for THIS row
+    mov     A, @R1
+    xrl     A, R5           ; A = debounced ^ new (0 if equal)
+    jz      ROW_STABLE      ; if: the reading matches, nothing is pending
+    
+    mov     A, R2           ; else: a change is pending. Is it the same as
+    add     A, #DEBOUNCE_CANDIDATE  ; the one seen on the last scan?
+    mov     R1, A           ; R1 -> candidate for THIS row
+    mov     A, @R1
+    xrl     A, R5
+    jz      SAME_CANDIDATE
+    
+    mov     A, R5           ; A different reading: it becomes the candidate
+    mov     @R1, A
+    mov     A, R2
+    add     A, #DEBOUNCE_COUNT
+    mov     R1, A           ; R1 -> count for THIS row
+    mov     @R1, DEBOUNCE_DEPTH ; and the count restarts
+    sjmp    CHECK_COUNT
+    
+SAME_CANDIDATE:
+    mov     A, R2
+    add     A, #DEBOUNCE_COUNT
+    mov     R1, A           ; R1 -> count for THIS row
+    
+CHECK_COUNT:
+    mov     A, @R1
+    jz      COMMIT_ROW      ; if: the candidate has been seen for long enough,
+    dec     @R1             ; else: wait for another scan
+    mov     R7, #1
+    sjmp    NEXT_ROW
+    
+COMMIT_ROW:
+    mov     A, R2           ; then: it becomes the debounced state
+    add     A, #DEBOUNCE_STATE
+    mov     R1, A
+    mov     A, R5
+    mov     @R1, A
+    mov     R3, #1          ; and the XAP must be told
+    sjmp    NEXT_ROW
+    
+ROW_STABLE:
+    mov     A, R2           ; Any pending change was a glitch: forget it
+    add     A, #DEBOUNCE_CANDIDATE
+    mov     R1, A
+    mov     A, R5
+    mov     @R1, A
     
-    inc     R1              ; Increment the memory pointer, ready for the next
-                            ; COLUMN.
+NEXT_ROW:
+    inc     R2              ; Increment the row index, ready for the next ROW.
     
     ret                     ; end sub-routine
     
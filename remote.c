@@ -28,6 +28,7 @@
 
 #include "remote.h"
 #include "nvm_access.h"
+#include "bond_table.h"
 #include "advertise.h"
 #include "event_handler.h"
 #include "app_gatt.h"
@@ -37,6 +38,8 @@
 #include "key_scan.h"
 #include "remote_hw.h"
 #include "notifications.h"
+#include "perf_stats.h"
+#include "event_trace.h"
 
 #include "service_gap.h"
 #include "service_hid.h"
@@ -57,18 +60,44 @@
  * - advertising
  * - input report sending
  * - gyroscope warm-up
- * - clear pairing key-press timer
+ * - key gesture timer (clear pairing key-press)
  * - infra-red transmissions
+ * - housekeeping (connection parameter updates, slave latency)
+ * - event trace flush (EVENT_TRACE_ENABLE builds)
  *
  * The following could be simultaneous:
  * 1. (when not connected) advertising, clear pairing, IR
  *      = 4
- * 2. (when connected) gyro warm-up, input report, bonding chance, IR
- *      = 4
+ * 2. (when connected) gyro warm-up, input report, bonding chance, IR,
+ *    housekeeping
+ *      = 5
+ * plus the event trace flush.
  */
-#define MAX_APP_TIMERS                      (5) 
+#if defined(EVENT_TRACE_ENABLE)
+#define MAX_APP_TIMERS                      (7) 
+#else
+#define MAX_APP_TIMERS                      (6) 
+#endif /* EVENT_TRACE_ENABLE */
                         /* In the best SW tradition, add one for luck */
 
+/* Number of words of NVM used in all: the core application data, the GAP
+ * service data, then a copy of the GATT, HID and Battery service data for
+ * each host in the bond table and one more used while pairing
+ */
+#define N_TOTAL_NVM_WORDS       (N_APP_USED_NVM_WORDS + \
+                                 GAP_SERVICE_NVM_MEMORY_WORDS + \
+                                 ((BOND_TABLE_SIZE + 1) * \
+                                  (GATT_SERV_CHANGED_NVM_MEMORY_WORDS + \
+                                   HID_SERVICE_NVM_MEMORY_WORDS + \
+                                   BATTERY_SERVICE_NVM_MEMORY_WORDS)))
+
+/* The build fails here if the NVM layout does not fit in the NVM given to
+ * the application: writes past its end would fail and bonds would be lost.
+ * Reduce BOND_TABLE_SIZE (or raise NVM_SIZE) if it does not fit.
+ */
+typedef uint8 NVM_LAYOUT_FITS_T[(N_TOTAL_NVM_WORDS <=
+                                 NVM_MAX_APP_MEMORY_WORDS) ? 1 : -1];
+
 /*=============================================================================
  *  Private Data
  *============================================================================*/
@@ -86,7 +115,7 @@ rominitfn_t ROMPioCtrlrInit = (rominitfn_t)0xE99F;
 /*=============================================================================
  *  Private Function Prototypes
  *============================================================================*/
-static void readPersistentStore(void);
+static uint16 readPersistentStore(void);
 void pio_ctrlr_code(void);  /* Included externally in PIO controller code.*/
 
 /*=============================================================================
@@ -100,11 +129,15 @@ void pio_ctrlr_code(void);  /* Included externally in PIO controller code.*/
  *  DESCRIPTION
  *      This function is used to initialise and read NVM data
  *
+ *  RETURNS
+ *      The last diversifier issued by the Security Manager.
+ *
  *----------------------------------------------------------------------------*/
-static void readPersistentStore(void)
+static uint16 readPersistentStore(void)
 {
     uint16 offset = N_APP_USED_NVM_WORDS;
     uint16 nvm_sanity = 0xffff;
+    uint16 sm_diversifier = 0;
 
     /* Read persistent storage to know if the device was last bonded 
      * to another device 
@@ -125,10 +158,8 @@ static void readPersistentStore(void)
 
     if(nvm_sanity == NVM_SANITY_MAGIC)
     {
-        /* Read Bonded Flag from NVM */
-        Nvm_Read((uint16*)&localData.bonded, 
-                 sizeof(localData.bonded), 
-                 NVM_OFFSET_BONDED_FLAG);
+        /* Read the hosts the device is bonded to */
+        BondTableRead();
         
 #if defined(IR_PROTOCOL_IRDB) || defined(IR_PROTOCOL_NEC) || defined(IR_PROTOCOL_RC5)
         /* Read IR controlled device */
@@ -137,31 +168,9 @@ static void readPersistentStore(void)
                  NVM_OFFSET_IR_CONTROLLED_DEVICE);
 #endif /* IR_PROTOCOL_IRDB || IR_PROTOCOL_NEC || IR_PROTOCOL_RC5 */
 
-        if(localData.bonded)
-        {
-            /* Bonded Host Typed BD Address will only be stored if bonded flag
-             * is set to TRUE. Read last bonded device address.
-             */
-            Nvm_Read((uint16*)&localData.bonded_bd_addr, 
-                     sizeof(TYPED_BD_ADDR_T), 
-                     NVM_OFFSET_BONDED_ADDR);
-
-            /* If the bonded device address is resolvable then read the bonded
-             * device's IRK
-             */
-            if(IsAddressResolvableRandom(&localData.bonded_bd_addr))
-            {
-                Nvm_Read(localData.central_device_irk.irk,
-                         MAX_WORDS_IRK,
-                         NVM_OFFSET_SM_IRK);
-            }
-        }
-        
-        /* Read the diversifier associated with the presently bonded/last bonded
-         * device.
-         */
-        Nvm_Read(&localData.diversifier,
-                 sizeof(localData.diversifier),
+        /* Read the diversifier issued to the last bonded device */
+        Nvm_Read(&sm_diversifier,
+                 sizeof(sm_diversifier),
                  NVM_OFFSET_SM_DIV);
 
         /* Read device name and length from NVM */
@@ -180,45 +189,26 @@ static void readPersistentStore(void)
                   NVM_OFFSET_SANITY_WORD);
 
         /* The device will not be bonded as it is coming up for the first time*/
-        localData.bonded = FALSE;
-
-        /* Write bonded status to NVM */
-        Nvm_Write((uint16*)&localData.bonded, 
-                  sizeof(localData.bonded),
-                  NVM_OFFSET_BONDED_FLAG);
-
-        /* The device is not bonded so don't have BD Address to update */
+        BondTableErase();
 
         /* When the remote is booting up for the first time after flashing the
          * image to it, it will not have bonded to any device. So, no LTK will
-         * be associated with it. So, set the diversifier to 0.
+         * be associated with it. So, write a diversifier of 0 to NVM.
          */
-        localData.diversifier = 0;
-
-        /* Write the same to NVM. */
-        Nvm_Write(&localData.diversifier, 
-                  sizeof(localData.diversifier),
+        Nvm_Write(&sm_diversifier, 
+                  sizeof(sm_diversifier),
                   NVM_OFFSET_SM_DIV);
 
         /* Write Gap data to NVM */
         GapInitWriteDataToNVM(&offset);
     }
     
-    /* Read/write GATT data to/from NVM */
-    GattReadDataFromNVM(&offset);
-
-    /* Read HID service data from NVM if the devices are bonded and  
-     * update the offset with the number of word of NVM required by 
-     * this service
+    /* Read/write the service data (GATT, HID and Battery) of each host
+     * to/from NVM and select the most recently used host
      */
-    HidReadDataFromNVM(localData.bonded, &offset);
+    BondTableInitServiceData(&offset);
 
-    /* Read Battery service data from NVM if the devices are bonded and  
-     * update the offset with the number of word of NVM required by 
-     * this service
-     */
-    BatteryReadDataFromNVM(localData.bonded, &offset);
-    
+    return sm_diversifier;
 }
 
 
@@ -246,12 +236,27 @@ extern void WakeRemoteIfRequired(void)
             /* Start advertising */
             stateSet(STATE_ADVERTISING);
         }
+        else if(((localData.state == STATE_FAST_ADVERT) ||
+                 (localData.state == STATE_SLOW_ADVERT)) &&
+                (localData.adv_stage > 0) && !localData.adv_restart)
+        {
+            /* The user is waiting for the connection: stop advertising and
+             * start the schedule again from the beginning.
+             */
+            localData.adv_restart = TRUE;
+            AdvStop();
+        }
     }
     
 #if defined(DISCONNECT_ON_IDLE)
     /* Some activity occurred, so reset the idle timer */
     handleResetIdleTimer();
 #endif /* DISCONNECT_ON_IDLE */
+
+#if defined(LINK_ACTIVITY_LOW_LATENCY)
+    /* Be ready for the host's response to the input */
+    handleLinkActivity();
+#endif /* LINK_ACTIVITY_LOW_LATENCY */
 }
 
 /*-----------------------------------------------------------------------------*
@@ -275,6 +280,7 @@ extern void RemoteDataInit(void)
     /* Delete all the timers */
     TimerDelete(localData.advertising_tid);
     localData.advertising_tid = TIMER_INVALID;
+    localData.adv_restart = FALSE;
 
     TimerDelete(localData.recrypt_tid);
     localData.recrypt_tid = TIMER_INVALID;
@@ -286,17 +292,23 @@ extern void RemoteDataInit(void)
     localData.actual_interval = PREFERRED_MIN_CON_INTERVAL;
     localData.actual_latency = (PREFERRED_SLAVE_LATENCY + 1);
     localData.actual_timeout = (PREFERRED_SUPERVISION_TIMEOUT + 1);
+#if defined(LINK_ACTIVITY_LOW_LATENCY)
+    localData.link_active = FALSE;
+#endif /* LINK_ACTIVITY_LOW_LATENCY */
 
     localData.disconnect_reason = DEFAULT_DISCONNECTION_REASON;
 
     MemSet(localData.latest_button_report, 0, HID_KEYPRESS_DATA_LENGTH);
+#if defined(KEYBOARD_REPORT_PRESENT)
+    MemSet(localData.latest_keyboard_report, 0, HID_KEYBOARD_DATA_LENGTH);
+#endif /* KEYBOARD_REPORT_PRESENT */
 
     TimerDelete(localData.next_report_timer_id);
     localData.next_report_timer_id = TIMER_INVALID;
 
-    /* Initialise GAP Data Structure */
-    GapDataInit();
-	
+    /* The GAP data only depends on the device name and the bonding, neither of
+     * which changes here; AppInit() and handleClearPairing() initialise it.
+     */
 
     /* HID Service data initialisation */
     HidDataInit();
@@ -310,9 +322,9 @@ extern void RemoteDataInit(void)
  *      AppUpdateWhiteList
  *
  *  DESCRIPTION
- *      This function updates the whitelist with bonded device address if
- *      it's not private, and also reconnection address when it has been written
- *      by the remote device.
+ *      This function updates the whitelist with the bonded device addresses
+ *      that are not private, and also reconnection address when it has been
+ *      written by the remote device.
  *
  *----------------------------------------------------------------------------*/
 
@@ -320,16 +332,13 @@ extern void AppUpdateWhiteList(void)
 {
     LsResetWhiteList();
     
-    if(localData.bonded && 
-            (!IsAddressResolvableRandom(&localData.bonded_bd_addr)) &&
-            (!IsAddressNonResolvableRandom(&localData.bonded_bd_addr)))
+    if(localData.bonded)
     {
-        /* If the device is bonded and bonded device address is not private
-         * (resolvable random or non-resolvable random), configure White list
-         * with the Bonded host address 
+        /* If the device is bonded, configure White list with the addresses
+         * of the Bonded hosts that are not private (resolvable random or
+         * non-resolvable random)
          */
-         
-        (void)LsAddWhiteListDevice(&localData.bonded_bd_addr);
+        BondTableUpdateWhiteList();
     }
 
 #ifdef __GAP_PRIVACY_SUPPORT__
@@ -345,6 +354,10 @@ extern void AppUpdateWhiteList(void)
 
 #endif /* __GAP_PRIVACY_SUPPORT__ */
 
+#if defined(FAST_RECONNECT)
+    /* The host to reconnect to may have changed */
+    AdvPrepareDirected();
+#endif /* FAST_RECONNECT */
 }
 
 
@@ -390,6 +403,7 @@ void AppInit(sleep_state LastSleepState)
 {
     uint16 gatt_database_length;
     uint16 *gatt_database_pointer = NULL;
+    uint16 sm_diversifier;
     
     /* Don't wakeup on UART RX line toggling */
     SleepWakeOnUartRX(FALSE);
@@ -404,6 +418,15 @@ void AppInit(sleep_state LastSleepState)
     /* Initialise the application timers */
     TimerInit(MAX_APP_TIMERS, (void*)app_timers);
 
+#if defined(DEBUG_ENABLE)
+    /* Initialise the debug UART, used for reporting */
+    DebugInit(1, NULL, NULL);
+#endif /* DEBUG_ENABLE */
+
+    /* Reset the performance statistics and the event trace */
+    perfInit();
+    traceInit();
+
     /* Initialise GATT entity */
     GattInit();
 
@@ -420,12 +443,12 @@ void AppInit(sleep_state LastSleepState)
     BatteryInitChipReset();
 
     /* Read persistent storage */
-    readPersistentStore();
+    sm_diversifier = readPersistentStore();
 
     /* Tell Security Manager module about the value it needs to initialize it's
      * diversifier to.
      */
-    SMInit(localData.diversifier);
+    SMInit(sm_diversifier);
     
     /* Initialise remote application data structure */
     RemoteDataInit();
@@ -472,6 +495,8 @@ void AppProcessSystemEvent(sys_event_id id, void *data)
     uint32 pioState;
 #endif /* AUDIO_BUTTON_PIO || ACCELEROMETER_INTERRUPT_PIO ||  GYROSCOPE_INTERRUPT_PIO || TOUCHSENSOR_INTERRUPT_PIO */
 
+    perfEventBegin();
+    traceSystemEvent(id, data);
 
     switch(id)
     {
@@ -490,22 +515,34 @@ void AppProcessSystemEvent(sys_event_id id, void *data)
             hwHandlePIOControllerEvent();
             break;
 
-#if defined(AUDIO_BUTTON_PIO) || defined(ACCELEROMETER_INTERRUPT_PIO) || defined(GYROSCOPE_INTERRUPT_PIO) || defined(TOUCHSENSOR_INTERRUPT_PIO)
+#if defined(AUDIO_BUTTON_PIO) || defined(ACCELEROMETER_INTERRUPT_PIO) || defined(GYROSCOPE_INTERRUPT_PIO) || defined(TOUCHSENSOR_INTERRUPT_PIO) || defined(KEYSCAN_IDLE_EDGE_WAKE)
         case sys_event_pio_changed: /* Event because of PIO state change.*/
+#if defined(AUDIO_BUTTON_PIO) || defined(ACCELEROMETER_INTERRUPT_PIO) || defined(GYROSCOPE_INTERRUPT_PIO) || defined(TOUCHSENSOR_INTERRUPT_PIO)
             /* Record the new PIO states*/
             pioState = ((pio_changed_data*)data)->pio_state;
+#endif /* AUDIO_BUTTON_PIO || ACCELEROMETER_INTERRUPT_PIO ||  GYROSCOPE_INTERRUPT_PIO || TOUCHSENSOR_INTERRUPT_PIO */
             
 #if defined(TOUCHSENSOR_PRESENT) && defined(TOUCHSENSOR_INTERRUPT_PIO)
             /* Pass the interrupt (pio) state to the touch-sensor module for processing */
             TouchsensorHandleInterrupt(pioState);
 #endif /* TOUCHSENSOR_INTERRUPT_PIO && TOUCHSENSOR_PRESENT */
+
+#if defined(KEYSCAN_IDLE_EDGE_WAKE)
+            /* A key has been pressed while the PIO controller was stopped */
+            if(((pio_changed_data*)data)->pio_cause & KEY_MATRIX_COLUMN_PIO_MASK)
+            {
+                hwHandleKeyscanEdge();
+            }
+#endif /* KEYSCAN_IDLE_EDGE_WAKE */
             break;
-#endif /* AUDIO_BUTTON_PIO || ACCELEROMETER_INTERRUPT_PIO ||  GYROSCOPE_INTERRUPT_PIO  || TOUCHSENSOR_INTERRUPT_PIO */
+#endif /* AUDIO_BUTTON_PIO || ACCELEROMETER_INTERRUPT_PIO ||  GYROSCOPE_INTERRUPT_PIO  || TOUCHSENSOR_INTERRUPT_PIO || KEYSCAN_IDLE_EDGE_WAKE */
 
         default:
             /* Do nothing. */
             break;
     }
+
+    perfEventEnd(PERF_EVENT_SYSTEM);
 }
 
 /*-----------------------------------------------------------------------------*
@@ -523,6 +560,9 @@ void AppProcessSystemEvent(sys_event_id id, void *data)
 
 bool AppProcessLmEvent(lm_event_code event_code, LM_EVENT_T *event_data)
 {
+    perfEventBegin();
+    traceLmEvent(event_code, event_data);
+
     switch(event_code)
     {
         /* Below messages are received in STATE_INIT state */
@@ -607,6 +647,8 @@ bool AppProcessLmEvent(lm_event_code event_code, LM_EVENT_T *event_data)
         
     }
 
+    perfEventEnd(PERF_EVENT_LM);
+
     return TRUE;    /* Indicate to the FW that we have finished processing this event. */
 }
 
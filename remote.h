@@ -36,7 +36,7 @@
 /* Maximum number of words in central device IRK */
 #define MAX_WORDS_IRK                   (8)
 
-/* Number of IRKs that application can store */
+/* Number of IRKs that application can store for each bonded host */
 #define MAX_NUMBER_IRK_STORED           (1)
 
 /* HID service may use different reports of different sizes.
@@ -83,6 +83,17 @@ typedef struct
      */
     timer_id advertising_tid;
 
+    /* The stage of the advertising schedule (see DECLARE_ADV_SCHEDULE()).
+     * Undirected advertising is in 'FAST_ADVERTISING' state up to the last
+     * stage, which is 'SLOW_ADVERTISING'.
+     */
+    uint16 adv_stage;
+
+    /* Advertising is being stopped to restart the schedule from the first
+     * stage, following user activity.
+     */
+    bool adv_restart;
+
     /* Timer to allow the remote device to re-encrypt a bonded link using
      * the old keys.
      */
@@ -93,12 +104,7 @@ typedef struct
      * MAX_NUM_CONN_PARAM_UPDATE_REQS, the application stops re-attempting to
      * update the connection parameters.
      */
-    /* The connection-parameter-update mechanism is active */
-    bool conn_param_counter_active;
-    /* The number of times connection parameter update requests have been sent. */
     uint8 conn_param_update_count;
-    /* The tick count (interval) between update requests. */
-    uint8 conn_param_update_tick_count;
     
 #if defined(DISCONNECT_ON_IDLE)
     /* The number of ticks received (in IDLE mode) on the way to disconnecting
@@ -118,7 +124,10 @@ typedef struct
     /* Track the UCID as Clients connect and disconnect */
     uint16 st_ucid;
 
-    /* Boolean flag to indicated whether the device is bonded */
+    /* Boolean flag to indicated whether the device is bonded to the current
+     * host (see bond_table.h). The bonding information that follows is that
+     * of the current host.
+     */
     bool bonded;
 
     /* TYPED_BD_ADDR_T of the host to which remote is bonded. */
@@ -145,6 +154,11 @@ typedef struct
      */
     uint8 latest_button_report[HID_KEYPRESS_DATA_LENGTH];
 
+#if defined(KEYBOARD_REPORT_PRESENT)
+    /* The latest keyboard report sent (or to be sent) to the Central */
+    uint8 latest_keyboard_report[HID_KEYBOARD_DATA_LENGTH];
+#endif /* KEYBOARD_REPORT_PRESENT */
+
 #if defined(ACCELEROMETER_PRESENT) || defined(GYROSCOPE_PRESENT) || defined(SPEECH_TX_PRESENT)
     /* The latest HID motion data to be sent to the Central */
     uint8 latest_motion_report[LARGEST_HID_REPORT_SIZE];
@@ -155,6 +169,10 @@ typedef struct
      */
     timer_id next_report_timer_id;
     uint16 actual_latency;
+#if defined(LINK_ACTIVITY_LOW_LATENCY)
+    /* Slave latency is turned off, following input activity */
+    bool link_active;
+#endif /* LINK_ACTIVITY_LOW_LATENCY */
     uint16 actual_timeout;
     uint16 actual_interval;
     
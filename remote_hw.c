@@ -28,6 +28,7 @@
 #include "notifications.h"
 #include "service_hid.h"
 #include "key_scan.h"
+#include "perf_stats.h"
 
 
 
@@ -48,14 +49,23 @@
  *  Private data
  *============================================================================*/
  
+#if defined(KEYSCAN_IDLE_EDGE_WAKE)
+/* Set while the PIO controller is stopped and a key-matrix column edge is
+ * awaited instead.
+ */
+static bool keyscanEdgeWait = FALSE;
+#endif /* KEYSCAN_IDLE_EDGE_WAKE */
 
 
 /*=============================================================================
  *  Private function declarations
  *============================================================================*/
 
-/* This function reads the latest key-scan information from the shared memory */
-static void readKeyData(uint8* data, uint16 dataSize);
+/* This function reads the oldest key-scan snapshot from the shared memory */
+static bool readKeyData(uint8* data, uint16 dataSize, uint16* scanCount);
+
+/* This function acts on one key-scan snapshot */
+static bool processKeySnapshot(uint8* keywords);
 
 /* This function handles key-scan matrix related PIO controller events */
 static void handleKeypadEvent(void);
@@ -65,6 +75,14 @@ static void handleKeypadEvent(void);
  */
 static bool notificationNowIsAppropriate(uint8 reportId);
 
+#if defined(KEYSCAN_IDLE_EDGE_WAKE)
+/* These functions stop and restart the PIO controller around a wait for a
+ * key-matrix column edge.
+ */
+static void enterKeyscanEdgeWait(void);
+static void leaveKeyscanEdgeWait(void);
+#endif /* KEYSCAN_IDLE_EDGE_WAKE */
+
 
 /*=============================================================================
  *  Private function definitions
@@ -72,27 +90,24 @@ static bool notificationNowIsAppropriate(uint8 reportId);
 
 /*----------------------------------------------------------------------------*
  *  NAME
- *      handleKeypadEvent
+ *      processKeySnapshot
  *
  *  DESCRIPTION
- *      This function handles key-scan matrix related PIO controller events.
- *      Mouse and IR interrupts are handled as necessary. If the interrupt is a
- *      button interrupt, first the key data is read from the PIO controller,
- *      then it is converted into a more readable form (button press information
- *      and a HID report) by keyscanProcessScanReport(). We can then carry out
- *      the appropriate actions depending on which key changed. We assume that
- *      only one key will change at a time as key-scan happens rather quickly,
- *      thus it is quite difficult to change two keys within one key-scan
- *      period, even when deliberately trying.
+ *      This function acts on one key-scan snapshot from the PIO controller.
+ *      The key data is converted into a more readable form (button press
+ *      information and a HID report) by keyscanProcessScanReport(). We can
+ *      then carry out the appropriate actions depending on which key changed.
+ *      Snapshots are taken on every debounced change, so a quick press and
+ *      release arrive as two snapshots even if they were handled together.
  *
  *  RETURNS
- *      Nothing
+ *      TRUE if no key at all is down in the snapshot. This is read from the
+ *      snapshot itself: a ghosted snapshot leaves the decoded key count as
+ *      it was, but still has keys down.
  *
  *---------------------------------------------------------------------------*/
-static void handleKeypadEvent(void)
+static bool processKeySnapshot(uint8* keywords)
 {
-    /* Raw key-scan data from PIO controller */
-    uint8 keywords[SCAN_MATRIX_ROWS_BYTE_COUNT];
     /* Processed scan report */
     uint8 hidKeypressReport[HID_KEYPRESS_DATA_LENGTH];
     /* Accompanying processed button information */
@@ -101,98 +116,180 @@ static void handleKeypadEvent(void)
     /* Temporary storage variables */
     bool validKeyPress = FALSE;
     uint8 reportID;
+    uint16 row;
     
     /* Persistent storage variables (across multiple calls to this function) */
     static BUTTON_TYPE lastKeyType = BUTTON_UNKNOWN;
     static uint8 lastNumConsumerKeys = 0;
 
-    /* Check if the interrupt is a button press or something else */
-    if(PIO_INTERRUPT_REASON & BUTTON_VALID)
-    {
-        /* It is, so initialise the HID report as all zeros. */
-        MemSet(hidKeypressReport, 0x00, HID_KEYPRESS_DATA_LENGTH);
-
-        /* Copy raw key data from the PIO controller shared memory */
-        readKeyData(keywords, SCAN_MATRIX_ROWS_BYTE_COUNT);
+    /* Initialise the HID report as all zeros. */
+    MemSet(hidKeypressReport, 0x00, HID_KEYPRESS_DATA_LENGTH);
 
-        /* Process this key data */
-        keyscanProcessScanReport(keywords, hidKeypressReport, &buttonInfo);
+    /* Process this key data */
+    keyscanProcessScanReport(keywords, hidKeypressReport, &buttonInfo);
 
 #if defined(IR_PROTOCOL_IRDB) || defined(IR_PROTOCOL_NEC) || defined(IR_PROTOCOL_RC5)
-        /* IR is handled during key data processing, so we only need to do 
-         * something if we are controlling the BLE host (i.e. not in IR mode).
-         */
-        if(localData.controlledDevice == IRCONTROL_HOST)                
+    /* IR is handled during key data processing, so we only need to do 
+     * something if we are controlling the BLE host (i.e. not in IR mode).
+     */
+    if(localData.controlledDevice == IRCONTROL_HOST)                
 #endif /* IR_PROTOCOL_IRDB || IR_PROTOCOL_NEC || IR_PROTOCOL_RC5 */
+    {
+        /* Work out which type of button has changed state */
+        switch(buttonInfo.pressedButtonType)
         {
-            /* Work out which type of button has changed state */
-            switch(buttonInfo.pressedButtonType)
-            {
 #if defined(SPEECH_TX_PRESENT) && !defined(AUDIO_BUTTON_PIO)
-                case BUTTON_AUDIO:
-                    /* PTT button must have been pressed (releases are handled
-                     * in audio mode rather than here in key-scan mode), so
-                     * reset the last button report to all zeros and enter audio
-                     * transmission mode.
-                     */
-                    MemSet(localData.latest_button_report, 0, HID_KEYPRESS_DATA_LENGTH);
-                    hwHandleAudioButtonPress(TRUE);
-                    break;
-                    
+            case BUTTON_AUDIO:
+                /* PTT button must have been pressed (releases are handled
+                 * in audio mode rather than here in key-scan mode), so
+                 * reset the last button report to all zeros and enter audio
+                 * transmission mode.
+                 */
+                MemSet(localData.latest_button_report, 0, HID_KEYPRESS_DATA_LENGTH);
+                hwHandleAudioButtonPress(TRUE);
+                break;
+                
 #endif /* SPEECH_TX_PRESENT */
-                default:
-                    /* A "normal" button changed state, check if the HID report has changed */
-                    if (   (MemCmp(hidKeypressReport, localData.latest_button_report, HID_KEYPRESS_DATA_LENGTH))
-                           /* Catch keys with same value (but on different HID pages) */
-                        || (lastKeyType != buttonInfo.pressedButtonType))
+            default:
+                /* A "normal" button changed state, check if the HID report has changed */
+                if (   (MemCmp(hidKeypressReport, localData.latest_button_report, HID_KEYPRESS_DATA_LENGTH))
+                       /* Catch keys with same value (but on different HID pages) */
+                    || (lastKeyType != buttonInfo.pressedButtonType))
+                {
+                    /* Required action depends on if other keys are currently held down */
+                    switch (lastKeyType)
                     {
-                        /* Required action depends on if other keys are currently held down */
-                        switch (lastKeyType)
-                        {
-                            case BUTTON_CONSUMER:
-                                /* There is already a Consumer button held down */
-                                if (   (buttonInfo.numPressedConsumerKeys == 0)
-                                    || (buttonInfo.numPressedConsumerKeys != lastNumConsumerKeys))
-                                {
-                                    /* The Consumer key was released or an extra one was pressed,
-                                     * so a HID report needs to be sent.
-                                     */
-                                    reportID = HID_CONSUMER_REPORT_ID;
-                                    validKeyPress = TRUE;
-                                }
-                                break;
-                            
-                            default:
-                                /* No key was previously held down. Send the new key press
-                                 * report as is, no extra conditioning is required.
+                        case BUTTON_CONSUMER:
+                            /* There is already a Consumer button held down */
+                            if (   (buttonInfo.numPressedConsumerKeys == 0)
+                                || (buttonInfo.numPressedConsumerKeys != lastNumConsumerKeys))
+                            {
+                                /* The Consumer key was released or an extra one was pressed,
+                                 * so a HID report needs to be sent.
                                  */
                                 reportID = HID_CONSUMER_REPORT_ID;
                                 validKeyPress = TRUE;
-                                break;
-                        }
+                            }
+                            break;
                         
-                        if (validKeyPress && notificationNowIsAppropriate(reportID))
-                        {
-                            /* Send the HID report */
-                            HidSendInputReport(reportID, hidKeypressReport, FALSE);
-                            /* Update persistent states for next time */
-                            lastKeyType = buttonInfo.pressedButtonType;
-                            lastNumConsumerKeys = buttonInfo.numPressedConsumerKeys;
-                        }
-                        
-                        /* Store the current new button report in appropriate variable */
-                        MemCopy(localData.latest_button_report, hidKeypressReport, HID_KEYPRESS_DATA_LENGTH);
-        
-                        /* If the remote has disconnected from the Central, reconnect now. */
-                        WakeRemoteIfRequired();
+                        default:
+                            /* No key was previously held down. Send the new key press
+                             * report as is, no extra conditioning is required.
+                             */
+                            reportID = HID_CONSUMER_REPORT_ID;
+                            validKeyPress = TRUE;
+                            break;
+                    }
+                    
+                    if (validKeyPress && notificationNowIsAppropriate(reportID))
+                    {
+                        /* Send the HID report */
+                        HidSendInputReport(reportID, hidKeypressReport, FALSE);
+                        /* Update persistent states for next time */
+                        lastKeyType = buttonInfo.pressedButtonType;
+                        lastNumConsumerKeys = buttonInfo.numPressedConsumerKeys;
                     }
-                    break;
                     
-            }   /* End switch(buttonInfo.pressedButtonType) */
-            
-        }   /* End if(localData.controlledDevice == IRCONTROL_HOST) */
+                    /* Store the current new button report in appropriate variable */
+                    MemCopy(localData.latest_button_report, hidKeypressReport, HID_KEYPRESS_DATA_LENGTH);
+    
+                    /* If the remote has disconnected from the Central, reconnect now. */
+                    WakeRemoteIfRequired();
+                }
+                break;
+                
+        }   /* End switch(buttonInfo.pressedButtonType) */
+
+#if defined(KEYBOARD_REPORT_PRESENT)
+        /* Every Keyboard button held down goes in one keyboard report */
+        if(buttonInfo.keyboardReportChanged)
+        {
+            keyscanGetKeyboardReport(localData.latest_keyboard_report);
+
+            if(notificationNowIsAppropriate(HID_KEYBOARD_REPORT_ID))
+            {
+                HidSendInputReport(HID_KEYBOARD_REPORT_ID, localData.latest_keyboard_report, FALSE);
+            }
+
+            /* If the remote has disconnected from the Central, reconnect now. */
+            WakeRemoteIfRequired();
+        }
+#endif /* KEYBOARD_REPORT_PRESENT */
         
+    }   /* End if(localData.controlledDevice == IRCONTROL_HOST) */
+
+    for(row = 0; row < SCAN_MATRIX_ROWS_BYTE_COUNT; row++)
+    {
+        if(keywords[row] != 0)
+        {
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+/*----------------------------------------------------------------------------*
+ *  NAME
+ *      handleKeypadEvent
+ *
+ *  DESCRIPTION
+ *      This function handles key-scan matrix related PIO controller events.
+ *      Mouse and IR interrupts are handled as necessary. If the interrupt is a
+ *      button interrupt, every key-scan snapshot waiting in the shared memory
+ *      is read and processed, oldest first. The PIO controller only
+ *      interrupts when its snapshot FIFO goes from empty to non-empty, so one
+ *      interrupt may cover a burst of key changes.
+ *
+ *  RETURNS
+ *      Nothing
+ *
+ *---------------------------------------------------------------------------*/
+static void handleKeypadEvent(void)
+{
+    /* Raw key-scan data from PIO controller */
+    uint8 keywords[SCAN_MATRIX_ROWS_BYTE_COUNT];
+    /* The PIO controller scan count at which the snapshot was taken */
+    uint16 scanCount;
+    /* No key at all is down in the latest snapshot */
+    bool allReleased = FALSE;
+    bool snapshotRead = FALSE;
+
+    /* Check if the interrupt is a button press or something else */
+    if(PIO_INTERRUPT_REASON & BUTTON_VALID)
+    {
+        /* Clear the interrupt before reading the snapshots, so that one
+         * published after the last of them is read raises a new interrupt.
+         */
         PIO_CLEAR_INTERRUPT(BUTTON_VALID);
+
+        /* Read the snapshots, for as long as the PIO controller is still
+         * key-scanning (processing a key may give it something else to do).
+         */
+        while((*(uint16*)PIO_CONTROL_WORD == PIO_CONTROLLER_KEYSCAN) &&
+              readKeyData(keywords, SCAN_MATRIX_ROWS_BYTE_COUNT, &scanCount))
+        {
+            /* Time-stamp the key change, for key-to-air latency measurement */
+            perfKeyEvent(scanCount);
+
+            allReleased = processKeySnapshot(keywords);
+            snapshotRead = TRUE;
+
+            /* Discard the time-stamp if no notification was queued for it */
+            perfKeyEventDone();
+        }
+
+        /* Once every key has been released, stop scanning until the next key
+         * press (unless the PIO controller has been given something else to
+         * do while handling this event). This goes by the raw snapshot, not
+         * the decoded key count, which a ghosted snapshot leaves at 0 while
+         * keys are still held.
+         */
+        if(snapshotRead && allReleased &&
+           (*(uint16*)PIO_CONTROL_WORD == PIO_CONTROLLER_KEYSCAN))
+        {
+            hwSetControllerForKeyscan(FALSE, FALSE, KEYSCAN_MODE_EDGE_WAIT);
+        }
     }
 
 }
@@ -223,44 +320,106 @@ static bool notificationNowIsAppropriate(uint8 report_id)
  *      readKeyData
  *
  *  DESCRIPTION
- *      Reads 8-bit key data from the PIO controller shared memory. The PIO
- *      controller scans through the key matrix one row at a time, comparing the
- *      value to the previous value for that row. Each row is 8 bits long, 1 bit
- *      for each column (up to 8 - not all columns have to be used). If any row
- *      has changed, then an interrupt is generated. The PIO controller uses the
- *      shared memory to store each of these rows in turn as it works through
- *      them, so when an interrupt is received we can just look at this data to
- *      see which key changed. A high bit indicates a pressed key, low bits are
- *      keys not currently pressed down. The PIO controller alternates between 2
- *      banks of memory for this purpose, so that the current key data is not
- *      overwritten whilst performing the next scan, and so that it has a record
- *      of the current keys to compare next set to.
+ *      Reads the oldest key-scan snapshot from the PIO controller shared
+ *      memory. The PIO controller scans through the key matrix one row at a
+ *      time. Each row is 8 bits long, 1 bit for each column (up to 8 - not all
+ *      columns have to be used). A high bit indicates a pressed key, low bits
+ *      are keys not currently pressed down. Whenever the (debounced) state of
+ *      any row changes, the controller adds a snapshot of all the rows to a
+ *      FIFO in the shared memory, together with the scan count at which it
+ *      was taken. Reading a snapshot hands its slot back to the controller.
  *
  *  PARAMETERS
  *      data        Pointer to target memory which will be written to.
  *      dataSize    Size of data to read and copy, in bytes.
+ *      scanCount   Set to the PIO controller scan count of the snapshot.
  *
  *  RETURNS/MODIFIES
- *      Nothing
+ *      TRUE if a snapshot was read, FALSE if the FIFO is empty.
  *
  *---------------------------------------------------------------------------*/
-static void readKeyData(uint8* data, uint16 dataSize)
+static bool readKeyData(uint8* data, uint16 dataSize, uint16* scanCount)
 {
-    uint16* srcMemory = PIO_DATA_BUFFER_START;
+    uint16* srcMemory = PIO_SNAPSHOT_FIFO_START;
+    const uint16 readSlot = PIO_SNAPSHOT_READ;
 
-    /* First bit tells which bank is being used for the data. Mask off the all
-     * other bits and check the first bit to see the bank being used.
-     */
-    if(PIO_VALID_DATA_BANK & USE_SECOND_DATA_BANK)
+    if(readSlot == PIO_SNAPSHOT_WRITE)
     {
-        /* use second bank */
-        srcMemory += (dataSize >> 1);   /* word -> byte conversion */
+        /* No snapshot is waiting */
+        return FALSE;
     }
 
-    /* copy and unpack the data */
-    MemCopyUnPack(data, srcMemory, dataSize);
+    srcMemory += (readSlot * PIO_SNAPSHOT_WORDS);
+
+    /* The first word is the scan count; copy and unpack the key data */
+    *scanCount = srcMemory[0];
+    MemCopyUnPack(data, srcMemory + 1, dataSize);
+
+    /* Hand the slot back to the PIO controller */
+    PIO_SNAPSHOT_READ = (readSlot + 1) % PIO_SNAPSHOT_SLOTS;
+
+    return TRUE;
 }
 
+#if defined(KEYSCAN_IDLE_EDGE_WAKE)
+/*----------------------------------------------------------------------------*
+ *  NAME
+ *      enterKeyscanEdgeWait
+ *
+ *  DESCRIPTION
+ *      Stops the PIO controller and takes the key-matrix PIOs back for the
+ *      XAP. All the rows are driven low, so pressing any key pulls its column
+ *      low against the column pull-up and raises a sys_event_pio_changed
+ *      event. Nothing is clocked while waiting.
+ *
+ *  RETURNS
+ *      Nothing
+ *
+ *---------------------------------------------------------------------------*/
+static void enterKeyscanEdgeWait(void)
+{
+    PioCtrlrStop();
+    *(uint16*)PIO_CONTROL_WORD = PIO_CONTROLLER_IDLE;
+
+    PioSetModes(KEY_MATRIX_PIO_BIT_MASK, pio_mode_user);
+    PioSetDirs(KEY_MATRIX_COLUMN_PIO_MASK, FALSE);
+    PioSets(KEY_MATRIX_ROW_PIO_MASK, 0UL);
+    PioSetDirs(KEY_MATRIX_ROW_PIO_MASK, TRUE);
+
+    PioSetEventMask(KEY_MATRIX_COLUMN_PIO_MASK, pio_event_mode_falling);
+
+    keyscanEdgeWait = TRUE;
+}
+
+/*----------------------------------------------------------------------------*
+ *  NAME
+ *      leaveKeyscanEdgeWait
+ *
+ *  DESCRIPTION
+ *      Hands the key-matrix PIOs back to the PIO controller and restarts it.
+ *      The controller code starts from its initialisation and always reports
+ *      its first debounced reading, so a key press is reported, and an edge
+ *      that was only a glitch returns the remote to waiting.
+ *
+ *  RETURNS
+ *      Nothing
+ *
+ *---------------------------------------------------------------------------*/
+static void leaveKeyscanEdgeWait(void)
+{
+    PioSetEventMask(KEY_MATRIX_COLUMN_PIO_MASK, pio_event_mode_disable);
+
+    PioSetDirs(KEY_MATRIX_ROW_PIO_MASK, FALSE);
+    PioSetModes(PIO_CONTROLLER_BIT_MASK, pio_mode_pio_controller);
+
+    /* The controller counters restart from zero */
+    perfKeyscanRestart();
+    hwStartController();
+
+    keyscanEdgeWait = FALSE;
+}
+
+#endif /* KEYSCAN_IDLE_EDGE_WAKE */
 
 /*=============================================================================
  *  Public function definitions
@@ -313,22 +472,74 @@ extern void hwConfigureAudioButtonPio(void)
 }
 
 #endif /* AUDIO_BUTTON_PIO */
+/*----------------------------------------------------------------------------*
+ *  NAME
+ *      hwStartController
+ *
+ *  DESCRIPTION
+ *      Starts the 8051 PIO controller code. Its initialisation goes straight
+ *      into key-scanning, so the debounce depth is written first.
+ *
+ *  RETURNS
+ *      Nothing
+ *
+ *---------------------------------------------------------------------------*/
+extern void hwStartController(void)
+{
+    PIO_DEBOUNCE_DEPTH = KEYSCAN_DEBOUNCE_DEPTH;
+    PioCtrlrStart();
+}
+
 /*----------------------------------------------------------------------------*
  *  NAME
  *      hwSetControllerForKeyscan
  *
  *  DESCRIPTION
- *      Sets the 8051 PIO controller to scanning the keyboard matrix.
+ *      Sets the 8051 PIO controller to scanning the keyboard matrix. In
+ *      KEYSCAN_MODE_EDGE_WAIT the controller is instead stopped until a key is
+ *      pressed (see KEYSCAN_IDLE_EDGE_WAKE); it carries on scanning if a key
+ *      is already down.
  *
  *---------------------------------------------------------------------------*/
-extern void hwSetControllerForKeyscan(bool interruptController,bool forceSlowClock)
+extern void hwSetControllerForKeyscan(bool interruptController,bool forceSlowClock,KEYSCAN_MODE mode)
 {
+#if defined(KEYSCAN_IDLE_EDGE_WAKE)
+    if(mode == KEYSCAN_MODE_EDGE_WAIT)
+    {
+        if(!keyscanEdgeWait)
+        {
+            enterKeyscanEdgeWait();
+        }
+
+        /* A key that went down before the column edge event was enabled does
+         * not raise one, so only wait if no key is down now.
+         */
+        if((PioGets() & KEY_MATRIX_COLUMN_PIO_MASK) == KEY_MATRIX_COLUMN_PIO_MASK)
+        {
+            /* Allow deep sleep */
+            SleepModeChange(sleep_mode_deep);
+            return;
+        }
+    }
+
+    if(keyscanEdgeWait)
+    {
+        /* Restart the PIO controller, which must then be told to scan */
+        leaveKeyscanEdgeWait();
+        interruptController = TRUE;
+        forceSlowClock = TRUE;
+    }
+#endif /* KEYSCAN_IDLE_EDGE_WAKE */
+
     if (forceSlowClock)
     {
         /* Reset PIO controller clock to 32kHz */
         PioCtrlrClock(FALSE);
     }
 
+    /* Tell the PIO controller how long a key change must be stable for */
+    PIO_DEBOUNCE_DEPTH = KEYSCAN_DEBOUNCE_DEPTH;
+
     if(interruptController)
     {
         /* Interrupt the PIO controller and set it to "key-scanning" */
@@ -340,6 +551,55 @@ extern void hwSetControllerForKeyscan(bool interruptController,bool forceSlowClo
     SleepModeChange(sleep_mode_deep);
 }
 
+#if defined(KEYSCAN_IDLE_EDGE_WAKE)
+/*----------------------------------------------------------------------------*
+ *  NAME
+ *      hwHandleKeyscanEdge
+ *
+ *  DESCRIPTION
+ *      Handles a falling edge on a key-matrix column. If the PIO controller
+ *      is stopped waiting for a key press, key-scanning is restarted.
+ *
+ *---------------------------------------------------------------------------*/
+extern void hwHandleKeyscanEdge(void)
+{
+    if(keyscanEdgeWait)
+    {
+        hwSetControllerForKeyscan(FALSE, TRUE, KEYSCAN_MODE_SCAN);
+    }
+}
+
+#endif /* KEYSCAN_IDLE_EDGE_WAKE */
+#if defined(KEY_AUTO_REPEAT)
+/*----------------------------------------------------------------------------*
+ *  NAME
+ *      hwSendKeyRepeat
+ *
+ *  DESCRIPTION
+ *      Sends the latest report of the given report ID again, for a key that
+ *      is being held down. Repeats are only sent while connected; they are
+ *      not held for a reconnection.
+ *
+ *---------------------------------------------------------------------------*/
+extern void hwSendKeyRepeat(uint8 report_id)
+{
+    uint8 *report = localData.latest_button_report;
+
+#if defined(KEYBOARD_REPORT_PRESENT)
+    if(report_id == HID_KEYBOARD_REPORT_ID)
+    {
+        report = localData.latest_keyboard_report;
+    }
+#endif /* KEYBOARD_REPORT_PRESENT */
+
+    if((localData.state & STATE_CONNECTED_NON_AUDIO) &&
+       notificationNowIsAppropriate(report_id))
+    {
+        HidRepeatInputReport(report_id, report);
+    }
+}
+
+#endif /* KEY_AUTO_REPEAT */
 #if defined(EXCLUSIVE_I2C_AND_KEYSCAN)||defined(IR_PROTOCOL_IRDB)
 /*----------------------------------------------------------------------------*
  *  NAME
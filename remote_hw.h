@@ -42,9 +42,6 @@
 #define PIO_DATA_BANK_START     (PIO_CONTROLLER_RAM_START + 24) /* 24 = 0x30 bytes -> words */
 #define PIO_DATA_BANK_READ      PIO_CONTROLLER_READ_R4
 
-/* This is the address that indicates which bank holds data valid for this interrupt */
-#define PIO_VALID_DATA_BANK     (PIO_DATA_BANK_READ)
-
 /* This is the address that indicates the reason for the interrupt.
  * The masks are defined in configuration.h
  */
@@ -59,9 +56,32 @@
 /* This is the 8051-to-XAP semaphore location */
 #define PIO_CTRL_TO_XAP_SEMAPHORE   (*(uint16*)(PIO_DATA_BANK_START+1))
 
-/* This is the address at which key-scan data starts */
-#define PIO_DATA_BUFFER_START   (PIO_DATA_BANK_START + 2)   
-                        /* 2-word offset to allow for the control semaphore */
+/* These are the write (PIO controller) and read (XAP) slot indices of the
+ * key-scan snapshot FIFO (FIFO_WRITE and FIFO_READ in pio_ctrlr_code.asm).
+ * The FIFO is empty when they are equal.
+ */
+#define PIO_SNAPSHOT_WRITE      (*(uint16*)(PIO_DATA_BANK_START + 2))
+#define PIO_SNAPSHOT_READ       (*(uint16*)(PIO_DATA_BANK_START + 3))
+
+/* These are the 16-bit counts of key-matrix scans and of XAP wake-ups, kept
+ * by the PIO controller (SCAN_COUNT and WAKE_COUNT in pio_ctrlr_code.asm).
+ * They wrap at 0xffff.
+ */
+#define PIO_SCAN_COUNT          (*(uint16*)(PIO_DATA_BANK_START + 4))
+#define PIO_WAKE_COUNT          (*(uint16*)(PIO_DATA_BANK_START + 5))
+
+/* This is the key-scan debounce depth read by the PIO controller
+ * (DEBOUNCE_DEPTH in pio_ctrlr_code.asm).
+ */
+#define PIO_DEBOUNCE_DEPTH      (*(uint16*)(PIO_DATA_BANK_START + 6))
+
+/* This is the address at which the key-scan snapshot FIFO starts (FIFO_BASE
+ * in pio_ctrlr_code.asm). Each snapshot is the scan count at which it was
+ * taken, followed by the key-scan data (one byte per row).
+ */
+#define PIO_SNAPSHOT_FIFO_START (PIO_DATA_BANK_START + 7)
+#define PIO_SNAPSHOT_SLOTS      (4)     /* FIFO_SLOTS */
+#define PIO_SNAPSHOT_WORDS      (3)     /* SNAPSHOT_SIZE, in words */
 
 /* This is the address at which audio data starts */
 #define PIO_AUDIO_BUFFER_START  (PIO_DATA_BANK_START)
@@ -76,14 +96,36 @@
 /* This flag in the control byte 0 is set if the IR waveform has a carrier 
    frequency. If this is cleared the IR waveform will consist of edges. */
 #define IR_CARRIER_MODE (1 << 2)
+
+/* How key presses are detected when key-scanning */
+typedef enum {
+    KEYSCAN_MODE_SCAN,          /* The PIO controller scans the matrix continuously */
+    KEYSCAN_MODE_EDGE_WAIT      /* The PIO controller is stopped until a column
+                                 * edge (KEYSCAN_IDLE_EDGE_WAKE builds only;
+                                 * otherwise the same as KEYSCAN_MODE_SCAN) */
+} KEYSCAN_MODE;
+
 /*=============================================================================
  *  Public function prototypes
  *============================================================================*/
 /* This function handles interrupts from the 8051 PIO controller */
 extern void hwHandlePIOControllerEvent(void);
 
+/* Start the 8051 PIO controller code, which begins key-scanning */
+extern void hwStartController(void);
+
 /* Configure the 8051 PIO controller to do key-scanning */
-extern void hwSetControllerForKeyscan(bool interruptController,bool forceSlowClock);
+extern void hwSetControllerForKeyscan(bool interruptController,bool forceSlowClock,KEYSCAN_MODE mode);
+
+#if defined(KEYSCAN_IDLE_EDGE_WAKE)
+/* This function handles a key-matrix column edge (sys_event_pio_changed) */
+extern void hwHandleKeyscanEdge(void);
+#endif /* KEYSCAN_IDLE_EDGE_WAKE */
+
+#if defined(KEY_AUTO_REPEAT)
+/* Send the latest report of the given report ID again, for a held key */
+extern void hwSendKeyRepeat(uint8 report_id);
+#endif /* KEY_AUTO_REPEAT */
 
 /* Configure the 8051 PIO controller to transmit IR command */
 
@@ -70,9 +70,6 @@ BATTERY_DATA_T g_batt_data;
 #define BATTERY_FULL_BATTERY_VOLTAGE                (3000)          /* 3.0V */
 #define BATTERY_FLAT_BATTERY_VOLTAGE                (1800)          /* 1.8V */
 
-/* Number of words of NVM memory used by Battery service */
-#define BATTERY_SERVICE_NVM_MEMORY_WORDS            (1)
-
 /* The offset of data being stored in NVM for Battery service. This offset is 
  * added to Battery service offset to NVM region (see g_batt_data.nvm_offset) 
  * to get the absolute offset at which this data is stored in NVM
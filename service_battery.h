@@ -18,6 +18,13 @@
 #include <types.h>
 #include <bt_event_types.h>
 
+/*=============================================================================*
+ *  Public Definitions
+ *============================================================================*/
+
+/* Number of words of NVM memory used by Battery service */
+#define BATTERY_SERVICE_NVM_MEMORY_WORDS            (1)
+
 /*=============================================================================*
  *  Public Function Prototypes
  *============================================================================*/
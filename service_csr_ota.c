@@ -34,8 +34,10 @@
 #include "app_gatt_db.h"
 #include "i2c_comms.h"
 #include "remote.h"
+#include "bond_table.h"
 #include "service_gatt.h"
 #include "service_csr_ota.h"
+#include "notifications.h"
 #include "uuids_csr_ota.h"
 
 /*============================================================================*
@@ -289,10 +291,10 @@ void OtaHandleAccessWrite(GATT_ACCESS_IND_T *p_ind)
                 if (data_transfer_configuration[0] ==
                                                 gatt_client_config_notification)
                 {
-                    GattCharValueNotification(localData.st_ucid, 
-                                              HANDLE_CSR_OTA_DATA_TRANSFER, 
-                                              data_transfer_data_length,
-                                              data_transfer_memory);
+                    /* Queued in the low-priority lane, behind input reports */
+                    notificationBufferItem(HANDLE_CSR_OTA_DATA_TRANSFER, 
+                                           data_transfer_data_length,
+                                           (uint16 *)data_transfer_memory);
                 }
                 break;
 
@@ -302,9 +304,9 @@ void OtaHandleAccessWrite(GATT_ACCESS_IND_T *p_ind)
                  */
                 
                 /* Record that the GATT database may be different after the
-                 * device has reset.
+                 * device has reset, for all the bonded hosts.
                  */
-                GattOnOtaSwitch();
+                BondTableOnOtaSwitch();
                 
                 /* When the disconnect confirmation comes in, call OtaReset() */
                 g_ota_reset_required = TRUE;
@@ -36,6 +36,7 @@
 #include "app_gatt_db.h"
 #include "nvm_access.h"
 #include "remote.h"
+#include "advertise.h"
 
 /*=============================================================================*
  *  Private Data Types
@@ -84,22 +85,8 @@ uint8 g_device_name[DEVICE_NAME_MAX_LENGTH + 2] =
  *  Private Definitions
  *============================================================================*/
 
-/* The offset of data being stored in NVM for GAP service. This offset is 
- * added to GAP service offset to NVM region (see g_gap_data.nvm_offset) 
- * to get the absolute offset at which this data is stored in NVM
- */
-#define GAP_NVM_DEVICE_NAME_LENGTH_OFFSET    (0)
-
-#define GAP_NVM_DEVICE_NAME_OFFSET           (1)
-
 #ifdef __GAP_PRIVACY_SUPPORT__
 
-#define GAP_NVM_DEVICE_PERIPHERAL_FLAG_OFFSET \
-                (GAP_NVM_DEVICE_NAME_OFFSET + DEVICE_NAME_MAX_LENGTH)
-
-#define GAP_NVM_DEVICE_RECONNECTION_ADDRESS_OFFSET \
-    (GAP_NVM_DEVICE_PERIPHERAL_FLAG_OFFSET + 1)
-
 /* Reconnection address can't be a resolvable random address. So make the two
  * most significant bits of reconnection address to have a resolvable random
  * address.
@@ -107,19 +94,6 @@ uint8 g_device_name[DEVICE_NAME_MAX_LENGTH + 2] =
 #define MAKE_RECONNECTION_ADDRESS_INVALID() \
     (g_gap_data.reconnect_address.nap = BD_ADDR_NAP_RANDOM_TYPE_RESOLVABLE)
 
-/* Number of words of NVM memory used by GAP service */
-
-/* Reconnection address takes 4 words of NVM space */
-#define GAP_SERVICE_NVM_MEMORY_WORDS \
-                                (GAP_NVM_DEVICE_RECONNECTION_ADDRESS_OFFSET + sizeof(BD_ADDR_T))
-
-#else
-
-/* If privacy is not supported, then only device name length and device name
- * are stored in NVM
- */
-#define GAP_SERVICE_NVM_MEMORY_WORDS    (GAP_NVM_DEVICE_NAME_OFFSET + DEVICE_NAME_MAX_LENGTH)
-
 #endif /* __GAP_PRIVACY_SUPPORT__ */
 
 /*=============================================================================*
@@ -184,6 +158,9 @@ static void updateDeviceName(uint16 length, uint8 *name)
     /* Null terminate the device name string */
     p_name[g_gap_data.length] = '\0';
 
+    /* The name in the advertising data has to be laid out again */
+    AdvInvalidatePayload();
+
     gapWriteDeviceNameToNvm();
 }
 
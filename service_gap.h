@@ -24,6 +24,42 @@
  *============================================================================*/
 
 #include "configuration.h"
+#include "app_gatt.h"
+
+/*=============================================================================*
+ *  Public Definitions
+ *============================================================================*/
+
+/* The offset of data being stored in NVM for GAP service. This offset is 
+ * added to GAP service offset to NVM region (see g_gap_data.nvm_offset) 
+ * to get the absolute offset at which this data is stored in NVM
+ */
+#define GAP_NVM_DEVICE_NAME_LENGTH_OFFSET    (0)
+
+#define GAP_NVM_DEVICE_NAME_OFFSET           (1)
+
+#ifdef __GAP_PRIVACY_SUPPORT__
+
+#define GAP_NVM_DEVICE_PERIPHERAL_FLAG_OFFSET \
+                (GAP_NVM_DEVICE_NAME_OFFSET + DEVICE_NAME_MAX_LENGTH)
+
+#define GAP_NVM_DEVICE_RECONNECTION_ADDRESS_OFFSET \
+    (GAP_NVM_DEVICE_PERIPHERAL_FLAG_OFFSET + 1)
+
+/* Number of words of NVM memory used by GAP service */
+
+/* Reconnection address takes 4 words of NVM space */
+#define GAP_SERVICE_NVM_MEMORY_WORDS \
+                                (GAP_NVM_DEVICE_RECONNECTION_ADDRESS_OFFSET + sizeof(BD_ADDR_T))
+
+#else
+
+/* If privacy is not supported, then only device name length and device name
+ * are stored in NVM
+ */
+#define GAP_SERVICE_NVM_MEMORY_WORDS    (GAP_NVM_DEVICE_NAME_OFFSET + DEVICE_NAME_MAX_LENGTH)
+
+#endif /* __GAP_PRIVACY_SUPPORT__ */
 
 /*=============================================================================*
  *  Public Function Prototypes
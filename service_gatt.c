@@ -38,11 +38,6 @@
                                 (GATT_NVM_SERV_CHANGED_CLIENT_CONFIG_OFFSET + \
                                  sizeof(gattData.service_changed_config))
 
-/* The maximum number of NVM words used by this GATT implementation */
-#define GATT_SERV_CHANGED_NVM_MEMORY_WORDS          \
-                                (GATT_NVM_SERV_CHANGED_SEND_IND + \
-                                 sizeof(gattData.service_changed))
-
 /*=============================================================================*
  *  Private Data Types
  *============================================================================*/
@@ -18,6 +18,17 @@
 
 #include <bt_event_types.h> /* Type definitions for Bluetooth events */
 
+/*=============================================================================*
+ *  Public Definitions
+ *============================================================================*/
+
+/* The maximum number of NVM words used by this GATT implementation: the
+ * Service Changed configuration and the "this device might have been
+ * updated" flag
+ */
+#define GATT_SERV_CHANGED_NVM_MEMORY_WORDS          \
+                                (sizeof(gatt_client_config) + sizeof(uint16))
+
 /*=============================================================================*
  *  Public Function Prototypes
  *============================================================================*/
@@ -35,9 +35,9 @@
 #include "key_scan.h"
 #include "notifications.h"
 #include "hid_descriptor.h"
-#if defined(DISCONNECT_ON_IDLE)
+#if defined(DISCONNECT_ON_IDLE) || defined(LINK_ACTIVITY_LOW_LATENCY)
 #include "event_handler.h"
-#endif /* DISCONNECT_ON_IDLE */
+#endif /* DISCONNECT_ON_IDLE || LINK_ACTIVITY_LOW_LATENCY */
 
 /*=============================================================================*
  *  Private Data Types
@@ -47,12 +47,22 @@ typedef struct
 {
     /* Reports Client Configuration */
     gatt_client_config      consumer_client_config;
+#if defined(KEYBOARD_REPORT_PRESENT)
+    gatt_client_config      keyboard_client_config;
+#endif /* KEYBOARD_REPORT_PRESENT */
     
     /* Set to TRUE if the HID device is suspended. By default set to FALSE (ie., 
      * Not Suspended)
      */
     bool                    suspended;
 
+#if defined(FAST_RECONNECT)
+    /* The Central has written a report Client Configuration during this
+     * connection
+     */
+    bool                    client_config_written;
+#endif /* FAST_RECONNECT */
+
     /* NVM offset at which HID data is stored */
     uint16                  nvm_offset;
 } HID_DATA_T;
@@ -71,16 +81,18 @@ timer_id latency_suspension_timer = TIMER_INVALID;
 /*=============================================================================*
  *  Private Definitions
  *============================================================================*/
-#define HID_SERVICE_NVM_MEMORY_WORDS_BASE                    (3)
-#define HID_SERVICE_USE_MOTION_DATA_HILLCREST_FORMAT         (0)
-#define HID_SERVICE_MOTION_REPORT_CONFIG_SIZE                (2) 
-
-#define HID_SERVICE_OTAU_OVER_HID_SIZE                       (0)
+/* Each report in the database must have its own Report ID */
+#if (HID_CONSUMER_REPORT_ID == HID_BATTERY_REPORT_ID)
+#error "HID_CONSUMER_REPORT_ID is also used by the Battery report"
+#endif
+#if defined(KEYBOARD_REPORT_PRESENT)
+#if (HID_KEYBOARD_REPORT_ID == HID_CONSUMER_REPORT_ID) || \
+    (HID_KEYBOARD_REPORT_ID == HID_BATTERY_REPORT_ID)
+#error "HID_KEYBOARD_REPORT_ID is also used by another report"
+#endif
+#endif /* KEYBOARD_REPORT_PRESENT */
 
-#define HID_SERVICE_IRTX_OVER_HID_SIZE                        (0)
-
-/* The base of Maximum usage */
-#define HID_SERVICE_NVM_MEMORY_WORDS                    (HID_SERVICE_NVM_MEMORY_WORDS_BASE + HID_SERVICE_MOTION_REPORT_CONFIG_SIZE + HID_SERVICE_OTAU_OVER_HID_SIZE + HID_SERVICE_IRTX_OVER_HID_SIZE)
+#define HID_SERVICE_USE_MOTION_DATA_HILLCREST_FORMAT         (0)
 
 /* The offset of data being stored in NVM for HID service. This offset is added
  * to HID service offset to NVM region (see hid_data.nvm_offset) to get the 
@@ -123,6 +135,9 @@ static void handleControlPointUpdate(hid_control_point_op control_op)
 #if defined(ENABLE_IGNORE_CL_ON_OUTPUT_HID)
              enableConnectionLatency(TIMER_INVALID);
 #endif /* ENABLE_IGNORE_CL_ON_OUTPUT_HID */
+#if defined(LINK_ACTIVITY_LOW_LATENCY)
+             handleLinkInactive();
+#endif /* LINK_ACTIVITY_LOW_LATENCY */
 
              /* Host has suspended its operations, application may like 
               * to do a low frequency key scan. The sample application is 
@@ -137,6 +152,11 @@ static void handleControlPointUpdate(hid_control_point_op control_op)
         {
              hid_data.suspended = FALSE;
 
+             /* Send the connection parameter update request deferred while
+              * the host was suspended (if any)
+              */
+             handleHidExitSuspend();
+
              /* Host has exited suspended mode, application may like 
               * to do a normal frequency key scan. The sample application is 
               * not doing any thing special in this case.
@@ -175,6 +195,13 @@ static void enableConnectionLatency(timer_id tid)
         TimerDelete(latency_suspension_timer);
     }
     latency_suspension_timer = TIMER_INVALID;
+#if defined(LINK_ACTIVITY_LOW_LATENCY)
+    /* Leave it off while input activity needs it off */
+    if(localData.link_active)
+    {
+        return;
+    }
+#endif /* LINK_ACTIVITY_LOW_LATENCY */
     LsDisableSlaveLatency(FALSE);
 }
 #endif /* ENABLE_IGNORE_CL_ON_OUTPUT_HID */
@@ -205,12 +232,22 @@ extern void HidDataInit(void)
                   sizeof(gatt_client_config), 
                   hid_data.nvm_offset + HID_NVM_CONSUMER_REPORT_CONFIG_OFFSET);
         
+#if defined(KEYBOARD_REPORT_PRESENT)
+        hid_data.keyboard_client_config = gatt_client_config_none;
+        Nvm_Write((uint16*)&hid_data.keyboard_client_config,
+                  sizeof(gatt_client_config), 
+                  hid_data.nvm_offset + HID_NVM_KEYBOARD_REPORT_CONFIG_OFFSET);
+#endif /* KEYBOARD_REPORT_PRESENT */
 
 
     }
 
     /* Default to Report Mode */
     hid_data.suspended = FALSE;
+
+#if defined(FAST_RECONNECT)
+    hid_data.client_config_written = FALSE;
+#endif /* FAST_RECONNECT */
 	
 }
 
@@ -254,6 +291,18 @@ extern void HidHandleAccessRead(GATT_ACCESS_IND_T *p_ind)
             length = ATTR_LEN_HID_CONSUMER_REPORT;
             break;
             
+#if defined(KEYBOARD_REPORT_PRESENT)
+        case HANDLE_HID_KEYBOARD_REPORT_CLIENT_CONFIG:
+            client_config = hid_data.keyboard_client_config;
+            break;
+
+        case HANDLE_HID_KEYBOARD_REPORT:
+            /* Remote device is reading the last keyboard report */
+            p_value = localData.latest_keyboard_report;
+            length = ATTR_LEN_HID_KEYBOARD_REPORT;
+            break;
+            
+#endif /* KEYBOARD_REPORT_PRESENT */
         default:
             /* Let firmware handle the request */
             rc = gatt_status_irq_proceed;
@@ -308,6 +357,13 @@ extern void HidHandleAccessWrite(GATT_ACCESS_IND_T *p_ind)
             offset = HID_NVM_CONSUMER_REPORT_CONFIG_OFFSET;
             break;
 
+#if defined(KEYBOARD_REPORT_PRESENT)
+        case HANDLE_HID_KEYBOARD_REPORT_CLIENT_CONFIG:
+            client_config_ptr = &hid_data.keyboard_client_config;
+            offset = HID_NVM_KEYBOARD_REPORT_CONFIG_OFFSET;
+            break;
+#endif /* KEYBOARD_REPORT_PRESENT */
+
             
 
 
@@ -334,6 +390,9 @@ extern void HidHandleAccessWrite(GATT_ACCESS_IND_T *p_ind)
         {
             /* store the new client configuration */
             *client_config_ptr = client_config;
+#if defined(FAST_RECONNECT)
+            hid_data.client_config_written = TRUE;
+#endif /* FAST_RECONNECT */
 
             /* offset to the start of the HID NVM area */
             offset += hid_data.nvm_offset;
@@ -375,6 +434,12 @@ extern bool HidIsNotifyEnabledOnReportId(uint8 report_id)
             result = (hid_data.consumer_client_config == gatt_client_config_notification);
             break;
             
+#if defined(KEYBOARD_REPORT_PRESENT)
+        case HID_KEYBOARD_REPORT_ID:
+            result = (hid_data.keyboard_client_config == gatt_client_config_notification);
+            break;
+            
+#endif /* KEYBOARD_REPORT_PRESENT */
         default:
             break;
     }
@@ -408,9 +473,58 @@ extern void HidSendInputReport(uint8 report_id, uint8 *report, bool force_send)
             }
             break;
 
+#if defined(KEYBOARD_REPORT_PRESENT)
+        case HID_KEYBOARD_REPORT_ID:
+            if(force_send)
+            {
+                notificationForceBufferItem(HANDLE_HID_KEYBOARD_REPORT, 
+                                            ATTR_LEN_HID_KEYBOARD_REPORT, 
+                                            (uint16*)report);
+            }
+            else
+            {
+                notificationBufferItem(HANDLE_HID_KEYBOARD_REPORT, 
+                                       ATTR_LEN_HID_KEYBOARD_REPORT, 
+                                       (uint16*)report);
+            }
+            break;
+#endif /* KEYBOARD_REPORT_PRESENT */
+
     }
 }
 
+#if defined(KEY_AUTO_REPEAT)
+/*-----------------------------------------------------------------------------
+ *  NAME
+ *      HidRepeatInputReport
+ *
+ *  DESCRIPTION
+ *      This function is used to send a report again while its key is held
+ *      down. A repeat still waiting to be sent is replaced rather than
+ *      another being queued.
+ *----------------------------------------------------------------------------*/
+extern void HidRepeatInputReport(uint8 report_id, uint8 *report)
+{
+    switch(report_id)
+    {
+        case HID_CONSUMER_REPORT_ID:
+            notificationRepeatItem(HANDLE_HID_CONSUMER_REPORT, 
+                                   ATTR_LEN_HID_CONSUMER_REPORT, 
+                                   (uint16*)report);
+            break;
+
+#if defined(KEYBOARD_REPORT_PRESENT)
+        case HID_KEYBOARD_REPORT_ID:
+            notificationRepeatItem(HANDLE_HID_KEYBOARD_REPORT, 
+                                   ATTR_LEN_HID_KEYBOARD_REPORT, 
+                                   (uint16*)report);
+            break;
+#endif /* KEYBOARD_REPORT_PRESENT */
+
+    }
+}
+#endif /* KEY_AUTO_REPEAT */
+
 /*-----------------------------------------------------------------------------
  *  NAME
  *      HidReadDataFromNVM
@@ -429,6 +543,13 @@ extern void HidReadDataFromNVM(bool bonded, uint16 *p_offset)
         Nvm_Read((uint16*)&hid_data.consumer_client_config,
                  sizeof(gatt_client_config),
                  hid_data.nvm_offset + HID_NVM_CONSUMER_REPORT_CONFIG_OFFSET);
+
+#if defined(KEYBOARD_REPORT_PRESENT)
+        /* Read KEYBOARD Report Client Configuration */
+        Nvm_Read((uint16*)&hid_data.keyboard_client_config,
+                 sizeof(gatt_client_config),
+                 hid_data.nvm_offset + HID_NVM_KEYBOARD_REPORT_CONFIG_OFFSET);
+#endif /* KEYBOARD_REPORT_PRESENT */
         
 
 
@@ -479,3 +600,22 @@ extern bool HidCheckHandleRange(uint16 handle)
     return hid_data.suspended;
 }
 
+#if defined(FAST_RECONNECT)
+/*-----------------------------------------------------------------------------
+ *  NAME
+ *      HidIsClientConfigWritten
+ *
+ *  DESCRIPTION
+ *      This function is used to check if the HID host has written any of the
+ *      input report Client Configurations since the connection was made.
+ *
+ *  RETURNS/MODIFIES
+ *      Boolean - TRUE if a Client Configuration has been written.
+ *
+ *----------------------------------------------------------------------------*/
+extern bool HidIsClientConfigWritten(void)
+{
+    return hid_data.client_config_written;
+}
+#endif /* FAST_RECONNECT */
+
@@ -44,6 +44,17 @@ typedef enum
     hid_rfu
 } hid_control_point_op;
 
+/* Number of words of NVM memory used by HID service */
+#define HID_SERVICE_NVM_MEMORY_WORDS_BASE                    (3)
+#define HID_SERVICE_MOTION_REPORT_CONFIG_SIZE                (2) 
+
+#define HID_SERVICE_OTAU_OVER_HID_SIZE                       (0)
+
+#define HID_SERVICE_IRTX_OVER_HID_SIZE                        (0)
+
+/* The base of Maximum usage */
+#define HID_SERVICE_NVM_MEMORY_WORDS                    (HID_SERVICE_NVM_MEMORY_WORDS_BASE + HID_SERVICE_MOTION_REPORT_CONFIG_SIZE + HID_SERVICE_OTAU_OVER_HID_SIZE + HID_SERVICE_IRTX_OVER_HID_SIZE)
+
 #if defined(ENABLE_IGNORE_CL_ON_OUTPUT_HID)
 /* Connection interval is in 1.25ms units. */
 /* 6 * CI is the spec tolerance for missed events.  See Bluetooth Spec [Vol 6] Part B, Section 4.5.2). */
@@ -70,6 +81,11 @@ extern bool HidIsNotifyEnabledOnReportId(uint8 report_id);
 /* Send a report to the Central. */
 extern void HidSendInputReport(uint8 report_id, uint8 *report, bool force_send);
 
+#if defined(KEY_AUTO_REPEAT)
+/* Send a report again (for a held key), replacing a repeat still queued. */
+extern void HidRepeatInputReport(uint8 report_id, uint8 *report);
+#endif /* KEY_AUTO_REPEAT */
+
 /* Read HID data from the non-volatile storage. This is used to recover
  * settings information about bonded devices.
  */
@@ -81,4 +97,11 @@ extern bool HidCheckHandleRange(uint16 handle);
 /* Determine whether the HID service has been suspended by the Central */
 extern bool HidIsStateSuspended(void);
 
+#if defined(FAST_RECONNECT)
+/* Determine whether the Central has written a report Client Configuration
+ * during this connection
+ */
+extern bool HidIsClientConfigWritten(void);
+#endif /* FAST_RECONNECT */
+
 #endif /* __HID_SERVICE_H__ */
@@ -27,6 +27,8 @@
 #include "service_hid.h"
 #include "notifications.h"
 #include "event_handler.h"
+#include "perf_stats.h"
+#include "event_trace.h"
 
 #if defined(__GAP_PRIVACY_SUPPORT__)
 #include "service_gap.h"
@@ -84,12 +86,12 @@ static CURRENT_STATE_T determineAdvertisingType(void)
 static void exitInitState(void)
 {
     /* Start running the PIO controller code */
-    PioCtrlrStart();
+    hwStartController();
 
      /* PIO controller code will be in a loop. It won't start key scanning unless
       * application interrupts it to do so (so do that now).
       */
-    hwSetControllerForKeyscan(TRUE, TRUE);
+    hwSetControllerForKeyscan(TRUE, TRUE, KEYSCAN_MODE_EDGE_WAIT);
 
     /* Application will start advertising upon exiting STATE_INIT state. So,
      * update the whitelist.
@@ -123,9 +125,13 @@ static void exitMotionState(void)
     /* Radio event notifications are received for all the data sent.
      * If enabled, these notifications come after the messages like
      * write response, read response are transmitted. So, disable
-     * these events when the mouse is not sending any reports
+     * these events when the mouse is not sending any reports (unless they
+     * are timing a batch of notifications)
      */
-    LsRadioEventNotification(localData.st_ucid, radio_event_none);
+    if(!notificationBatchPending())
+    {
+        LsRadioEventNotification(localData.st_ucid, radio_event_none);
+    }
 
     TimerDelete(localData.next_report_timer_id);
     localData.next_report_timer_id = TIMER_INVALID;
@@ -161,11 +167,11 @@ static void enterAdvertisingState(void)
         /* Directed advertisement doesn't use any timer. Directed
          * advertisements are done for 1.28 seconds always.
          */
-        AdvStart(FALSE, gap_mode_connect_directed);
+        AdvStart(0, gap_mode_connect_directed);
     }
     else
     {
-        AdvStart((localData.state == STATE_FAST_ADVERT), gap_mode_connect_undirected);
+        AdvStart(localData.adv_stage, gap_mode_connect_undirected);
     }
 }
 
@@ -311,6 +317,9 @@ extern void stateSet(CURRENT_STATE_T new_state)
     
     if(new_state != old_state)
     {
+        /* Account the time spent in the old state */
+        perfEnergyCheckpoint();
+
         /* Handle exiting old state */
         switch (old_state)
         {
@@ -340,9 +349,14 @@ extern void stateSet(CURRENT_STATE_T new_state)
         if(new_state == STATE_ADVERTISING)
         {
             new_state = determineAdvertisingType();
+
+            /* Start from the beginning of the advertising schedule */
+            localData.adv_stage = 0;
+            localData.adv_restart = FALSE;
         }
             
         localData.state = new_state;
+        traceStateChange(new_state);
     
         /* Handle entering new state */
         switch (new_state)